@@ -0,0 +1,477 @@
+#ifndef ASTEROID_FIELD_H
+#define ASTEROID_FIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <ThreadPool.h>
+#include <FrustumCuller.h>
+#include <VertexLayout.h>
+#include <Mesh.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+//per-instance data of one asteroid, streamed through an InstanceBuffer
+//24 bytes instead of a full mat4 plus a float (68 bytes)
+//asteroids are only scaled uniformly, so the vertex shader can transform normals with the rotation alone
+struct AsteroidInstance
+{
+	glm::vec3 position;
+	//half floats
+	uint16_t scale;
+	uint16_t rotationSpeed;
+	//unit quaternion (x, y, z, w) as snorm16
+	int16_t orientation[4];
+};
+
+//quantise one asteroid into the compact instance format
+AsteroidInstance packAsteroidInstance(const glm::vec3& position, float scale, const glm::quat& orientation, float rotationSpeed)
+{
+	AsteroidInstance instance;
+	instance.position = position;
+	instance.scale = glm::packHalf1x16(scale);
+	instance.rotationSpeed = glm::packHalf1x16(rotationSpeed);
+
+	glm::quat q = glm::normalize(orientation);
+	instance.orientation[0] = static_cast<int16_t>(glm::packSnorm1x16(q.x));
+	instance.orientation[1] = static_cast<int16_t>(glm::packSnorm1x16(q.y));
+	instance.orientation[2] = static_cast<int16_t>(glm::packSnorm1x16(q.z));
+	instance.orientation[3] = static_cast<int16_t>(glm::packSnorm1x16(q.w));
+	return instance;
+}
+
+//angle an asteroid has revolved around the planet after 'time' (the shader's uTime)
+//must match the revolve rotation in asteroids.vertex
+float asteroidRevolveAngle(float time, float rotationSpeed)
+{
+	return glm::radians(time * rotationSpeed) * 0.01f;
+}
+
+//screen-size driven level of detail selection
+struct LodSettings
+{
+	//number of levels the model has
+	unsigned int levels;
+	//projected radius in pixels down to which level 0 is used, every halving of the size moves one level coarser
+	float referencePixels;
+	//added to the selected level, positive values switch to coarser levels sooner
+	float bias;
+	//projected size in pixels of a unit radius at unit distance: (viewport height / 2) / tan(fov / 2)
+	float pixelScale;
+	//beyond this distance asteroids are drawn as impostors (level 'levels'), 0 disables the impostor tier
+	float impostorDistance;
+};
+
+LodSettings makeLodSettings(unsigned int levels, float fovY, float viewportHeight, float bias, float impostorDistance = 0.0f,
+	float referencePixels = 32.0f)
+{
+	LodSettings settings;
+	settings.levels = levels;
+	settings.referencePixels = referencePixels;
+	settings.bias = bias;
+	settings.pixelScale = viewportHeight * 0.5f / tan(fovY * 0.5f);
+	settings.impostorDistance = impostorDistance;
+	return settings;
+}
+
+//level of a sphere of 'radius' at 'distance' from the camera, 'levels' itself stands for the impostor tier
+//must match the selection in cull.vertex
+unsigned int selectLod(float radius, float distance, const LodSettings& settings)
+{
+	if (settings.impostorDistance > 0.0f && distance > settings.impostorDistance)
+		return settings.levels;
+	float pixels = radius * settings.pixelScale / max(distance, 0.001f);
+	float level = floor(log2(settings.referencePixels / pixels) + settings.bias);
+	return static_cast<unsigned int>(glm::clamp(level, 0.0f, static_cast<float>(settings.levels - 1)));
+}
+
+//node of an asteroid sector tree, bounds are in the frame of its speed group (i.e. before the revolve)
+struct AsteroidSector
+{
+	glm::vec3 centre;
+	float radius;
+	//smallest & largest asteroid bounding radius inside, for picking the level of detail of the whole sector
+	float minRadius;
+	float maxRadius;
+	//contiguous range of asteroids covered
+	unsigned int first;
+	unsigned int count;
+	//index of the first of the two children (the second follows it), 0 for leaves
+	unsigned int children;
+};
+
+//asteroids sharing one rotation speed revolve together as a rigid body, so their sectors never drift apart
+struct AsteroidSpeedGroup
+{
+	float rotationSpeed;
+	//root of the group's sector tree
+	unsigned int root;
+};
+
+//all asteroids of the belt on the CPU, plus the structure-of-arrays copy of their bounds used for culling
+//the asteroids are split by rotation speed and each group into a tree of compact sectors (median splits along the longest
+//axis), stored so that every sector covers a contiguous range of instances
+//culling walks the trees in each group's own revolving frame, and only the asteroids of sectors that are partly visible
+//are tested one by one, so the per-frame cost follows what is on screen rather than the size of the belt
+class AsteroidField
+{
+public:
+	vector<AsteroidInstance> instances;
+
+	//bounding spheres before the revolve (in the frame of their speed group)
+	vector<float> centreX;
+	vector<float> centreY;
+	vector<float> centreZ;
+	vector<float> radius;
+
+	//most asteroids per leaf sector
+	unsigned int sectorSize;
+	vector<AsteroidSector> sectors;
+	vector<AsteroidSpeedGroup> groups;
+
+	AsteroidField() : sectorSize(128)
+	{
+	}
+
+	unsigned int size() const { return static_cast<unsigned int>(instances.size()); }
+
+	void add(const AsteroidInstance& instance)
+	{
+		instances.push_back(instance);
+	}
+
+	//sort the instances into sectors and unpack them into the culling arrays
+	//'meshRadius' is the bounding radius of the unscaled rock model
+	void buildBounds(float meshRadius, ThreadPool& pool)
+	{
+		build(meshRadius, [&](unsigned int count, const function<void(unsigned int, unsigned int)>& func)
+			{
+				pool.parallelFor(count, 1, func);
+			});
+	}
+
+	//the same on the calling thread only, e.g. from inside a pool task
+	void buildBounds(float meshRadius)
+	{
+		build(meshRadius, [](unsigned int count, const function<void(unsigned int, unsigned int)>& func)
+			{
+				func(0, count);
+			});
+	}
+
+	SphereArrays bounds() const
+	{
+		SphereArrays spheres;
+		spheres.x = centreX.data();
+		spheres.y = centreY.data();
+		spheres.z = centreZ.data();
+		spheres.radius = radius.data();
+		spheres.count = size();
+		return spheres;
+	}
+
+	//first culling step: walk the sector trees and keep the runs of asteroids that may be visible at 'time'
+	//sectors outside the frustum or behind the planet are dropped, sectors entirely visible are kept without further tests
+	void cullSectors(const Frustum& frustum, const OcclusionCone& cone, float time, ThreadPool& pool)
+	{
+		unsigned int groupCount = static_cast<unsigned int>(groups.size());
+		groupFrustums.resize(groupCount);
+		groupCones.resize(groupCount);
+		groupRuns.resize(groupCount);
+
+		pool.parallelFor(groupCount, 4, [&](unsigned int begin, unsigned int end)
+			{
+				vector<unsigned int> stack;
+				for (unsigned int g = begin; g < end; g++)
+				{
+					//bring the frustum and cone into the group's frame instead of moving its asteroids
+					float angle = asteroidRevolveAngle(time, groups[g].rotationSpeed);
+					groupFrustums[g] = rotateFrustumY(frustum, cos(angle), sin(angle));
+					groupCones[g] = rotateConeY(cone, cos(angle), sin(angle));
+					const Frustum& localFrustum = groupFrustums[g];
+					const OcclusionCone& localCone = groupCones[g];
+
+					vector<SphereRun>& kept = groupRuns[g];
+					kept.clear();
+					stack.assign(1, groups[g].root);
+					while (!stack.empty())
+					{
+						const AsteroidSector& sector = sectors[stack.back()];
+						stack.pop_back();
+						if (!sphereInFrustum(localFrustum, sector.centre, sector.radius) || sphereOccluded(localCone, sector.centre, sector.radius))
+							continue;
+
+						bool inside = sphereInsideFrustum(localFrustum, sector.centre, sector.radius)
+							&& sphereUnoccluded(localCone, sector.centre, sector.radius);
+						if (inside || !sector.children)
+						{
+							kept.push_back({ sector.first, sector.count, g, inside });
+						}
+						else
+						{
+							//second child first, so runs come out in ascending order
+							stack.push_back(sector.children + 1);
+							stack.push_back(sector.children);
+						}
+					}
+				}
+			});
+
+		runs.clear();
+		for (const vector<SphereRun>& group : groupRuns)
+			runs.insert(runs.end(), group.begin(), group.end());
+	}
+
+	//the runs kept by the last cullSectors()
+	const vector<SphereRun>& visibleRuns() const { return runs; }
+
+	//second culling step on the CPU: test the asteroids of the kept runs one by one
+	void cullInstances(FrustumCuller& culler, vector<unsigned int>& visible)
+	{
+		culler.cull(bounds(), runs, groupFrustums, groupCones, visible, runVisible);
+	}
+
+	//reorder the visible asteroids by level of detail, so each level is one contiguous instanced draw
+	//'lodFirst' receives levels + 2 entries: level l covers [lodFirst[l], lodFirst[l + 1]) of 'sorted',
+	//the last range (level 'levels') holds the impostors
+	//'visible' must come from cullInstances(), whole runs whose sector falls into a single level skip the per-asteroid choice
+	void sortByLod(const vector<unsigned int>& visible, const LodSettings& settings,
+		vector<unsigned int>& sorted, vector<unsigned int>& lodFirst, ThreadPool& pool)
+	{
+		unsigned int count = static_cast<unsigned int>(visible.size());
+		visibleLod.resize(count);
+		pool.parallelFor(static_cast<unsigned int>(runs.size()), 16, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int r = begin; r < end; r++)
+				{
+					const SphereRun& run = runs[r];
+					unsigned int first = runVisible[r];
+					unsigned int last = runVisible[r + 1];
+					if (first == last)
+						continue;
+
+					//the camera in the run's frame
+					glm::vec3 eye = groupCones[run.view].eye;
+
+					//smallest and largest possible level over the run: largest asteroid nearest, smallest one farthest
+					const AsteroidSector& sector = runSector(run);
+					float centreDistance = glm::length(sector.centre - eye);
+					unsigned int finest = selectLod(sector.maxRadius, max(centreDistance - sector.radius, 0.0f), settings);
+					unsigned int coarsest = selectLod(sector.minRadius, centreDistance + sector.radius, settings);
+					if (finest == coarsest)
+					{
+						memset(&visibleLod[first], static_cast<int>(finest), last - first);
+						continue;
+					}
+
+					for (unsigned int i = first; i < last; i++)
+					{
+						unsigned int index = visible[i];
+						glm::vec3 centre(centreX[index], centreY[index], centreZ[index]);
+						visibleLod[i] = static_cast<uint8_t>(selectLod(radius[index], glm::length(centre - eye), settings));
+					}
+				}
+			});
+
+		//counting sort, the histogram's prefix sum gives each level its start
+		lodFirst.assign(settings.levels + 2, 0);
+		for (unsigned int i = 0; i < count; i++)
+			lodFirst[visibleLod[i] + 1]++;
+		for (unsigned int l = 0; l <= settings.levels; l++)
+			lodFirst[l + 1] += lodFirst[l];
+
+		sorted.resize(count);
+		lodCursor.assign(lodFirst.begin(), lodFirst.end() - 1);
+		for (unsigned int i = 0; i < count; i++)
+			sorted[lodCursor[visibleLod[i]]++] = visible[i];
+	}
+
+	//copy the instances listed in 'indices' to 'out', in order
+	void gather(const vector<unsigned int>& indices, AsteroidInstance* out, ThreadPool& pool) const
+	{
+		pool.parallelFor(static_cast<unsigned int>(indices.size()), 8192, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; i++)
+					out[i] = instances[indices[i]];
+			});
+	}
+
+private:
+	//per speed group view of the last cullSectors(), and the runs it kept
+	vector<Frustum> groupFrustums;
+	vector<OcclusionCone> groupCones;
+	vector<vector<SphereRun>> groupRuns;
+	vector<SphereRun> runs;
+	vector<unsigned int> runVisible;
+
+	//scratch of sortByLod
+	vector<uint8_t> visibleLod;
+	vector<unsigned int> lodCursor;
+
+	//buildBounds, 'forEachGroup(count, func)' runs func over [0, count) in pieces
+	template <typename ForEachGroup>
+	void build(float meshRadius, ForEachGroup forEachGroup)
+	{
+		unsigned int count = size();
+		centreX.resize(count);
+		centreY.resize(count);
+		centreZ.resize(count);
+		radius.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const AsteroidInstance& instance = instances[i];
+			centreX[i] = instance.position.x;
+			centreY[i] = instance.position.y;
+			centreZ[i] = instance.position.z;
+			//the half-float scale rounds, so pad the radius slightly
+			radius[i] = glm::unpackHalf1x16(instance.scale) * meshRadius * 1.01f;
+		}
+
+		//group by rotation speed (compared as the stored half float, so equal speeds revolve identically)
+		//speeds come in steps of 0.1, so a belt has only a handful of groups however many asteroids it holds
+		vector<float> speed(count);
+		vector<unsigned int> order(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			speed[i] = glm::unpackHalf1x16(instances[i].rotationSpeed);
+			order[i] = i;
+		}
+		stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return speed[a] < speed[b]; });
+
+		groups.clear();
+		vector<unsigned int> groupFirst;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			uint16_t speed = instances[order[i]].rotationSpeed;
+			if (i == 0 || speed != instances[order[i - 1]].rotationSpeed)
+			{
+				groups.push_back({ glm::unpackHalf1x16(speed), 0 });
+				groupFirst.push_back(i);
+			}
+		}
+		groupFirst.push_back(count);
+
+		//every group builds its own tree, the trees are joined afterwards
+		vector<vector<AsteroidSector>> groupSectors(groups.size());
+		forEachGroup(static_cast<unsigned int>(groups.size()), [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int g = begin; g < end; g++)
+				{
+					groupSectors[g].push_back(AsteroidSector());
+					buildSector(groupSectors[g], 0, order, groupFirst[g], groupFirst[g + 1] - groupFirst[g]);
+				}
+			});
+
+		sectors.clear();
+		for (unsigned int g = 0; g < groups.size(); g++)
+		{
+			unsigned int base = static_cast<unsigned int>(sectors.size());
+			groups[g].root = base;
+			for (AsteroidSector sector : groupSectors[g])
+			{
+				if (sector.children)
+					sector.children += base;
+				sectors.push_back(sector);
+			}
+		}
+
+		permute(instances, order);
+		permute(centreX, order);
+		permute(centreY, order);
+		permute(centreZ, order);
+		permute(radius, order);
+	}
+
+	//fill sectors[node] with the asteroids order[first, first + count), splitting it until the leaves are small enough
+	void buildSector(vector<AsteroidSector>& tree, unsigned int node, vector<unsigned int>& order, unsigned int first, unsigned int count)
+	{
+		glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+		float minRadius = FLT_MAX, maxRadius = 0.0f;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			unsigned int index = order[i];
+			glm::vec3 centre(centreX[index], centreY[index], centreZ[index]);
+			low = glm::min(low, centre);
+			high = glm::max(high, centre);
+			minRadius = min(minRadius, radius[index]);
+			maxRadius = max(maxRadius, radius[index]);
+		}
+
+		//bounding sphere around the box centre, reaching the farthest asteroid sphere
+		glm::vec3 middle = (low + high) * 0.5f;
+		float reach = 0.0f;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			unsigned int index = order[i];
+			reach = max(reach, glm::length(glm::vec3(centreX[index], centreY[index], centreZ[index]) - middle) + radius[index]);
+		}
+		tree[node] = { middle, reach, minRadius, maxRadius, first, count, 0 };
+		if (count <= sectorSize)
+			return;
+
+		//median split along the longest axis of the box
+		glm::vec3 extent = high - low;
+		const vector<float>& axis = extent.x >= extent.y && extent.x >= extent.z ? centreX : (extent.y >= extent.z ? centreY : centreZ);
+		unsigned int half = count / 2;
+		nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+			[&](unsigned int a, unsigned int b) { return axis[a] < axis[b]; });
+
+		unsigned int children = static_cast<unsigned int>(tree.size());
+		tree[node].children = children;
+		tree.resize(children + 2);
+		buildSector(tree, children, order, first, half);
+		buildSector(tree, children + 1, order, first + half, count - half);
+	}
+
+	//the sector a run was taken from (a leaf, or an inner sector kept whole)
+	const AsteroidSector& runSector(const SphereRun& run) const
+	{
+		unsigned int node = groups[run.view].root;
+		while (sectors[node].first != run.first || sectors[node].count != run.count)
+		{
+			unsigned int left = sectors[node].children;
+			node = run.first < sectors[left + 1].first ? left : left + 1;
+		}
+		return sectors[node];
+	}
+
+	template <typename T>
+	static void permute(vector<T>& values, const vector<unsigned int>& order)
+	{
+		vector<T> sorted(values.size());
+		for (unsigned int i = 0; i < order.size(); i++)
+			sorted[i] = values[order[i]];
+		values.swap(sorted);
+	}
+};
+
+//instance attributes of the asteroid draws, added on top of a mesh's vertex layout
+using AsteroidInstanceLayout = InstanceLayout<InstancePos3f, InstanceScaleSpeed2h, InstanceOrientation4s>;
+static_assert(AsteroidInstanceLayout::stride == sizeof(AsteroidInstance)
+	&& AsteroidInstanceLayout::offset(1) == offsetof(AsteroidInstance, scale)
+	&& AsteroidInstanceLayout::offset(2) == offsetof(AsteroidInstance, orientation), "AsteroidInstanceLayout doesn't match AsteroidInstance");
+static_assert(layoutsDisjoint<FullVertexLayout, AsteroidInstanceLayout>() && layoutsDisjoint<CompactVertexLayout, AsteroidInstanceLayout>()
+	&& layoutsDisjoint<QuantizedVertexLayout, AsteroidInstanceLayout>(), "asteroid instance attributes collide with a mesh vertex attribute");
+
+//point the instance attributes (locations 3-5) of a mesh VAO at 'buffer', starting at byte 'offset'
+//the offset moves every frame with the ring region of the instance buffer, so this is called before each draw
+void setupAsteroidInstanceAttributes(unsigned int VAO, unsigned int buffer, GLintptr offset)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	AsteroidInstanceLayout::setup(offset);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
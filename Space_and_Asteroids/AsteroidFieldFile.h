@@ -0,0 +1,207 @@
+#ifndef ASTEROID_FIELD_FILE_H
+#define ASTEROID_FIELD_FILE_H
+
+#include <AsteroidField.h>
+#include <AsteroidGenerator.h>
+#include <MappedFile.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//binary asteroid field, written once and memory mapped on load
+//layout (little endian, every section 16-byte aligned):
+//  header
+//  speed groups       groupCount x AsteroidSpeedGroup
+//  sector tree        sectorCount x AsteroidSector
+//  instances          count x AsteroidInstance, in sector order
+//  bounds             centreX, centreY, centreZ, radius, count floats each
+//sections are stored exactly as AsteroidField holds them, so loading is a handful of block copies and no parsing
+const char asteroidFieldMagic[4] = { 'A', 'S', 'T', 'F' };
+const uint32_t asteroidFieldVersion = 1;
+const uint32_t asteroidFieldByteOrder = 0x01020304u;
+
+struct AsteroidFieldFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	//catches files from a machine with another byte order or struct layout
+	uint32_t byteOrder;
+	uint32_t instanceBytes;
+	uint32_t sectorBytes;
+	uint32_t groupBytes;
+
+	uint32_t count;
+	uint32_t sectorCount;
+	uint32_t groupCount;
+	//AsteroidField::sectorSize the tree was built with
+	uint32_t leafSize;
+	//bounding radius of the rock the bounds were computed for
+	float meshRadius;
+	uint32_t padding;
+	//identifies the seed & parameters the belt was generated from, see asteroidFieldKey
+	uint64_t key;
+
+	uint64_t groupOffset;
+	uint64_t sectorOffset;
+	uint64_t instanceOffset;
+	uint64_t boundsOffset;
+};
+
+//hash of everything a generated belt depends on
+uint64_t asteroidFieldKey(uint64_t seed, const AsteroidFieldParams& params)
+{
+	float values[] = { params.radius, params.offset, params.heightFactor, params.minScale, params.maxScale,
+		params.maxRotationSpeed, params.rotationSpeedStep };
+	uint64_t key = splitMix64(seed ^ splitMix64(params.count));
+	for (float value : values)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		key = splitMix64(key ^ bits);
+	}
+	return key;
+}
+
+//write 'field' (after buildBounds) to 'path', creating its directory if needed
+bool saveAsteroidField(const string& path, const AsteroidField& field, float meshRadius, uint64_t key)
+{
+	auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+	AsteroidFieldFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, asteroidFieldMagic, sizeof(header.magic));
+	header.version = asteroidFieldVersion;
+	header.byteOrder = asteroidFieldByteOrder;
+	header.instanceBytes = sizeof(AsteroidInstance);
+	header.sectorBytes = sizeof(AsteroidSector);
+	header.groupBytes = sizeof(AsteroidSpeedGroup);
+	header.count = field.size();
+	header.sectorCount = static_cast<uint32_t>(field.sectors.size());
+	header.groupCount = static_cast<uint32_t>(field.groups.size());
+	header.leafSize = field.sectorSize;
+	header.meshRadius = meshRadius;
+	header.key = key;
+	header.groupOffset = align(sizeof(header));
+	header.sectorOffset = align(header.groupOffset + header.groupCount * sizeof(AsteroidSpeedGroup));
+	header.instanceOffset = align(header.sectorOffset + header.sectorCount * sizeof(AsteroidSector));
+	header.boundsOffset = align(header.instanceOffset + uint64_t(header.count) * sizeof(AsteroidInstance));
+
+	filesystem::path directory = filesystem::path(path).parent_path();
+	error_code error;
+	if (!directory.empty())
+		filesystem::create_directories(directory, error);
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+	{
+		cout << "ERROR::ASTEROID_FIELD::FILE_NOT_WRITABLE: " << path << endl;
+		return false;
+	}
+
+	auto writeAt = [&](uint64_t offset, const void* data, size_t bytes)
+	{
+		static const char zeros[16] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		file.write(zeros, static_cast<streamsize>(offset - position));
+		file.write(static_cast<const char*>(data), static_cast<streamsize>(bytes));
+	};
+	writeAt(0, &header, sizeof(header));
+	writeAt(header.groupOffset, field.groups.data(), field.groups.size() * sizeof(AsteroidSpeedGroup));
+	writeAt(header.sectorOffset, field.sectors.data(), field.sectors.size() * sizeof(AsteroidSector));
+	writeAt(header.instanceOffset, field.instances.data(), field.instances.size() * sizeof(AsteroidInstance));
+	size_t boundsBytes = field.size() * sizeof(float);
+	writeAt(header.boundsOffset, field.centreX.data(), boundsBytes);
+	file.write(reinterpret_cast<const char*>(field.centreY.data()), boundsBytes);
+	file.write(reinterpret_cast<const char*>(field.centreZ.data()), boundsBytes);
+	file.write(reinterpret_cast<const char*>(field.radius.data()), boundsBytes);
+
+	if (!file)
+	{
+		cout << "ERROR::ASTEROID_FIELD::WRITE_FAILED: " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+//fill 'field' from the file at 'path', ready to cull and draw
+//fails (leaving 'field' untouched) if the file is missing, of another version or layout, built for another rock,
+//or, unless 'key' is 0, generated from other parameters
+bool loadAsteroidField(const string& path, AsteroidField& field, float meshRadius, uint64_t key)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	AsteroidFieldFileHeader header;
+	if (file.size() < sizeof(header))
+	{
+		cout << "ERROR::ASTEROID_FIELD::FILE_TRUNCATED: " << path << endl;
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, asteroidFieldMagic, sizeof(header.magic)) != 0 || header.byteOrder != asteroidFieldByteOrder
+		|| header.instanceBytes != sizeof(AsteroidInstance) || header.sectorBytes != sizeof(AsteroidSector)
+		|| header.groupBytes != sizeof(AsteroidSpeedGroup))
+	{
+		cout << "ERROR::ASTEROID_FIELD::NOT_AN_ASTEROID_FIELD: " << path << endl;
+		return false;
+	}
+	if (header.version != asteroidFieldVersion)
+	{
+		cout << "ERROR::ASTEROID_FIELD::VERSION_MISMATCH: " << path << " is version " << header.version << endl;
+		return false;
+	}
+	if (header.meshRadius != meshRadius || (key != 0 && header.key != key))
+		return false;
+	if (header.boundsOffset + uint64_t(header.count) * sizeof(float) * 4 > file.size()
+		|| header.instanceOffset + uint64_t(header.count) * sizeof(AsteroidInstance) > header.boundsOffset
+		|| header.sectorOffset + uint64_t(header.sectorCount) * sizeof(AsteroidSector) > header.instanceOffset
+		|| header.groupOffset + uint64_t(header.groupCount) * sizeof(AsteroidSpeedGroup) > header.sectorOffset)
+	{
+		cout << "ERROR::ASTEROID_FIELD::FILE_TRUNCATED: " << path << endl;
+		return false;
+	}
+
+	const unsigned char* data = file.data();
+	const AsteroidSpeedGroup* groups = reinterpret_cast<const AsteroidSpeedGroup*>(data + header.groupOffset);
+	const AsteroidSector* sectors = reinterpret_cast<const AsteroidSector*>(data + header.sectorOffset);
+	const AsteroidInstance* instances = reinterpret_cast<const AsteroidInstance*>(data + header.instanceOffset);
+	const float* bounds = reinterpret_cast<const float*>(data + header.boundsOffset);
+
+	//files may come from other machines, so the tree's indices are checked before culling follows them:
+	//sectors cover asteroids of the file, children come after their parent (so walks can't loop) and both exist,
+	//and every group's root is a sector
+	bool valid = true;
+	for (uint32_t i = 0; i < header.sectorCount && valid; i++)
+	{
+		const AsteroidSector& sector = sectors[i];
+		valid = uint64_t(sector.first) + sector.count <= header.count
+			&& (sector.children == 0 || (sector.children > i && uint64_t(sector.children) + 1 < header.sectorCount));
+	}
+	for (uint32_t i = 0; i < header.groupCount && valid; i++)
+		valid = groups[i].root < header.sectorCount;
+	if (!valid)
+	{
+		cout << "ERROR::ASTEROID_FIELD::CORRUPT: " << path << endl;
+		return false;
+	}
+
+	field.sectorSize = header.leafSize;
+	field.groups.assign(groups, groups + header.groupCount);
+	field.sectors.assign(sectors, sectors + header.sectorCount);
+	field.instances.assign(instances, instances + header.count);
+	field.centreX.assign(bounds, bounds + header.count);
+	field.centreY.assign(bounds + header.count, bounds + header.count * 2);
+	field.centreZ.assign(bounds + header.count * 2, bounds + header.count * 3);
+	field.radius.assign(bounds + header.count * 3, bounds + header.count * 4);
+	return true;
+}
+
+#endif
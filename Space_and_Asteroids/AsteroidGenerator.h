@@ -0,0 +1,154 @@
+#ifndef ASTEROID_GENERATOR_H
+#define ASTEROID_GENERATOR_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.h>
+#include <AsteroidField.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+//shape of a generated asteroid belt
+struct AsteroidFieldParams
+{
+	unsigned int count;
+	//distance of the belt's centre line from the planet's axis
+	float radius;
+	//asteroids are displaced from the centre line by up to 'offset' horizontally...
+	float offset;
+	//...and up to 'offset * heightFactor' vertically
+	float heightFactor;
+	float minScale;
+	float maxScale;
+	//rotation speeds are multiples of 'rotationSpeedStep' in [0, maxRotationSpeed)
+	//few distinct speeds keep the sector tree's speed groups large (see AsteroidField)
+	float maxRotationSpeed;
+	float rotationSpeedStep;
+};
+
+AsteroidFieldParams defaultAsteroidFieldParams(unsigned int count)
+{
+	AsteroidFieldParams params;
+	params.count = count;
+	params.radius = 500.0f;
+	params.offset = 100.0f;
+	params.heightFactor = 0.4f;
+	params.minScale = 0.1f;
+	params.maxScale = 0.3f;
+	params.maxRotationSpeed = 10.0f;
+	params.rotationSpeedStep = 0.1f;
+	return params;
+}
+
+//SplitMix64 finaliser, a strong 64-bit mix
+uint64_t splitMix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+//counter-based random numbers: draw number 'draw' of asteroid 'index' depends on nothing but (seed, index, draw),
+//so any asteroid can be generated on its own, in any order, on any thread
+struct AsteroidRandom
+{
+	uint64_t key;
+
+	AsteroidRandom(uint64_t seed, uint64_t index) : key(splitMix64(seed ^ splitMix64(index)))
+	{
+	}
+
+	//uniform in [0, 1), the top 24 bits convert to float exactly
+	float uniform(uint32_t draw) const
+	{
+		return static_cast<float>(splitMix64(key + draw) >> 40) * (1.0f / 16777216.0f);
+	}
+
+	//uniform in [low, high)
+	float uniform(uint32_t draw, float low, float high) const
+	{
+		return low + (high - low) * uniform(draw);
+	}
+};
+
+//number of distinct rotation speeds of a belt
+unsigned int asteroidSpeedSteps(const AsteroidFieldParams& params)
+{
+	return max(1u, static_cast<unsigned int>(params.maxRotationSpeed / params.rotationSpeedStep + 0.5f));
+}
+
+//one asteroid at ring angle 'angle' revolving at 'rotationSpeed', draws 1-5 of 'random' pick the rest
+AsteroidInstance makeAsteroid(const AsteroidRandom& random, float angle, float rotationSpeed, const AsteroidFieldParams& params)
+{
+	float x = sin(angle) * params.radius + random.uniform(1, -params.offset, params.offset);
+	float y = random.uniform(2, -params.offset, params.offset) * params.heightFactor;
+	float z = cos(angle) * params.radius + random.uniform(3, -params.offset, params.offset);
+
+	float scale = random.uniform(4, params.minScale, params.maxScale);
+
+	//random rotation around a fixed axis
+	float rotAngle = random.uniform(5, 0.0f, glm::two_pi<float>());
+	glm::quat orientation = glm::angleAxis(rotAngle, glm::normalize(glm::vec3(0.4f, 0.6f, 0.8f)));
+
+	return packAsteroidInstance(glm::vec3(x, y, z), scale, orientation, rotationSpeed);
+}
+
+//asteroid 'index' of the belt described by 'params'
+AsteroidInstance generateAsteroid(uint64_t seed, unsigned int index, const AsteroidFieldParams& params)
+{
+	AsteroidRandom random(seed, index);
+
+	//spread along the ring by index, jittered within the index's own slice
+	float angle = (index + random.uniform(0)) / params.count * glm::two_pi<float>();
+	float rotationSpeed = floor(random.uniform(6) * asteroidSpeedSteps(params)) * params.rotationSpeedStep;
+	return makeAsteroid(random, angle, rotationSpeed, params);
+}
+
+//a streamed belt is cut into chunks: 'slices' equal angular slices of the ring, each split again by rotation speed
+//every asteroid of a chunk revolves at the same speed, so a chunk moves as a rigid body and its bounds never spread
+unsigned int asteroidChunkCount(const AsteroidFieldParams& params, unsigned int slices)
+{
+	return slices * asteroidSpeedSteps(params);
+}
+
+unsigned int asteroidsPerChunk(const AsteroidFieldParams& params, unsigned int slices)
+{
+	return max(1u, params.count / asteroidChunkCount(params, slices));
+}
+
+//write the asteroids of chunk 'chunk' (slice = chunk % slices, speed step = chunk / slices) to 'out'
+//like generateAsteroid, each one only depends on the seed and its own number, here counted over the whole belt
+void generateAsteroidChunk(uint64_t seed, const AsteroidFieldParams& params, unsigned int slices, unsigned int chunk, AsteroidInstance* out)
+{
+	unsigned int perChunk = asteroidsPerChunk(params, slices);
+	unsigned int slice = chunk % slices;
+	float rotationSpeed = (chunk / slices) * params.rotationSpeedStep;
+	for (unsigned int i = 0; i < perChunk; i++)
+	{
+		AsteroidRandom random(seed, static_cast<uint64_t>(chunk) * perChunk + i);
+		float angle = (slice + random.uniform(0)) / slices * glm::two_pi<float>();
+		out[i] = makeAsteroid(random, angle, rotationSpeed, params);
+	}
+}
+
+//fill 'field' with the belt described by 'params', in parallel
+//the result is bit-identical for a given seed whatever the number of threads
+void generateAsteroidField(uint64_t seed, const AsteroidFieldParams& params, AsteroidField& field, ThreadPool& pool)
+{
+	field.instances.resize(params.count);
+	pool.parallelFor(params.count, 16384, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				field.instances[i] = generateAsteroid(seed, i, params);
+		});
+}
+
+#endif
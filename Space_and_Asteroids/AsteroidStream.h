@@ -0,0 +1,275 @@
+#ifndef ASTEROID_STREAM_H
+#define ASTEROID_STREAM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.h>
+#include <AsteroidField.h>
+#include <AsteroidGenerator.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//asteroids of one chunk of a streamed belt (see generateAsteroidChunk)
+struct AsteroidChunk
+{
+	unsigned int id;
+	vector<AsteroidInstance> instances;
+};
+
+//a belt far too large to keep in memory, of which only the chunks near the camera are resident
+//chunks are generated on background threads as the camera approaches and the least recently needed ones are evicted
+//once the budget is reached, so memory use and the number of drawable asteroids have a fixed ceiling
+//the resident chunks are merged into an ordinary AsteroidField, rebuilt in the background and swapped in when ready,
+//so culling, LOD selection and drawing work on it exactly as on a fully generated belt
+//'memoryBudget' covers everything held per resident asteroid: its chunk, its copy in both the drawn and the next field
+//with their bounds and sector trees, and the scratch of a rebuild (see bytesPerAsteroid)
+class AsteroidStream
+{
+public:
+	//'slices' angular slices per rotation speed, chunks whose bounds come within 'streamDistance' of the camera are loaded
+	AsteroidStream(uint64_t seed, const AsteroidFieldParams& params, float meshRadius, unsigned int slices,
+		float streamDistance, size_t memoryBudget, unsigned int threads = 2)
+		: seed(seed), params(params), meshRadius(meshRadius), slices(slices), streamDistance(streamDistance),
+		chunkCount(asteroidChunkCount(params, slices)), perChunk(asteroidsPerChunk(params, slices)),
+		loaded(chunkCount), requested(chunkCount, false), lruEntry(chunkCount), lastNeeded(chunkCount, 0),
+		frame(0), inFlight(0), backBytes(0), residencyChanged(false), rebuilding(false), rebuildDone(false), swapped(false), pool(threads)
+	{
+		size_t chunkBytes = perChunk * bytesPerAsteroid();
+		maxChunks = static_cast<unsigned int>(max<size_t>(1, min<size_t>(memoryBudget / chunkBytes, chunkCount)));
+		maxInFlight = max(1u, threads) * 2;
+
+		//every chunk is a thin slice of the ring, displaced from the centre line by up to 'offset'
+		float halfSlice = glm::pi<float>() / slices;
+		float displacement = sqrt(2.0f * params.offset * params.offset + params.offset * params.heightFactor * params.offset * params.heightFactor);
+		chunkRadius = 2.0f * params.radius * sin(halfSlice * 0.5f) + displacement + params.maxScale * meshRadius;
+	}
+
+	AsteroidStream(const AsteroidStream&) = delete;
+	AsteroidStream& operator=(const AsteroidStream&) = delete;
+
+	//the belt made of the resident chunks, valid until the next update() returning true
+	AsteroidField& field() { return front; }
+
+	//most asteroids field() can ever hold, size the instance buffer with this
+	unsigned int maxInstances() const { return maxChunks * perChunk; }
+
+	//bytes held for the belt: the resident chunks and both fields (the one drawn and the one rebuilt in the background,
+	//as of its last swap)
+	size_t residentBytes() const { return lru.size() * perChunk * sizeof(AsteroidInstance) + fieldBytes(front) + backBytes; }
+
+	//most bytes one resident asteroid costs, what 'memoryBudget' is divided by
+	static size_t bytesPerAsteroid()
+	{
+		//leaves are split once they pass sectorSize, so they hold more than half of it, and a tree has under twice as
+		//many sectors as leaves
+		size_t sectorBytes = 4 * sizeof(AsteroidSector) / AsteroidField().sectorSize + 1;
+		size_t fieldBytes = sizeof(AsteroidInstance) + 4 * sizeof(float) + sectorBytes;
+		//build() sorts through an order and a speed per asteroid and permutes the instances through a copy
+		size_t rebuildBytes = sizeof(unsigned int) + sizeof(float) + sizeof(AsteroidInstance);
+		return sizeof(AsteroidInstance) + 2 * fieldBytes + rebuildBytes;
+	}
+
+	unsigned int residentChunks() const { return static_cast<unsigned int>(lru.size()); }
+
+	//request the chunks around 'cameraPos' at 'time', collect finished ones and evict what does not fit the budget
+	//returns true when a new field() has been swapped in
+	bool update(const glm::vec3& cameraPos, float time)
+	{
+		frame++;
+
+		vector<shared_ptr<AsteroidChunk>> arrived;
+		{
+			lock_guard<mutex> lock(readyMutex);
+			arrived.swap(ready);
+		}
+		for (shared_ptr<AsteroidChunk>& chunk : arrived)
+		{
+			inFlight--;
+			requested[chunk->id] = false;
+			lru.push_front(chunk->id);
+			lruEntry[chunk->id] = lru.begin();
+			loaded[chunk->id] = move(chunk);
+			residencyChanged = true;
+		}
+
+		//chunks in reach, nearest first; only as many as fit the budget count as needed
+		needed.clear();
+		unsigned int speedSteps = asteroidSpeedSteps(params);
+		for (unsigned int s = 0; s < speedSteps; s++)
+		{
+			//bring the camera into the frame the chunks of this speed were generated in
+			float angle = asteroidRevolveAngle(time, s * params.rotationSpeedStep);
+			float c = cos(angle), sn = sin(angle);
+			glm::vec3 eye(c * cameraPos.x - sn * cameraPos.z, cameraPos.y, sn * cameraPos.x + c * cameraPos.z);
+			for (unsigned int k = 0; k < slices; k++)
+			{
+				float distance = glm::length(chunkCentre(k) - eye) - chunkRadius;
+				if (distance <= streamDistance)
+					needed.push_back(make_pair(distance, s * slices + k));
+			}
+		}
+		sort(needed.begin(), needed.end());
+		if (needed.size() > maxChunks)
+			needed.resize(maxChunks);
+
+		for (const pair<float, unsigned int>& chunk : needed)
+		{
+			unsigned int id = chunk.second;
+			lastNeeded[id] = frame;
+			if (loaded[id])
+			{
+				//move to the front of the LRU list
+				lru.splice(lru.begin(), lru, lruEntry[id]);
+			}
+		}
+
+		for (const pair<float, unsigned int>& chunk : needed)
+		{
+			unsigned int id = chunk.second;
+			if (loaded[id] || requested[id])
+				continue;
+			if (inFlight >= maxInFlight)
+				break;
+			//make room by evicting the least recently needed chunks that are not needed now
+			while (lru.size() + inFlight >= maxChunks && !lru.empty() && lastNeeded[lru.back()] != frame)
+				evict(lru.back());
+			if (lru.size() + inFlight >= maxChunks)
+				break;
+			request(id);
+		}
+
+		if (rebuildDone)
+		{
+			swap(front, back);
+			backBytes = fieldBytes(back);
+			rebuilding = false;
+			rebuildDone = false;
+			swapped = true;
+		}
+		if (residencyChanged && !rebuilding)
+		{
+			residencyChanged = false;
+			rebuild();
+		}
+
+		bool result = swapped;
+		swapped = false;
+		return result;
+	}
+
+private:
+	uint64_t seed;
+	AsteroidFieldParams params;
+	float meshRadius;
+	unsigned int slices;
+	float streamDistance;
+	float chunkRadius;
+	unsigned int chunkCount;
+	unsigned int perChunk;
+	unsigned int maxChunks;
+	unsigned int maxInFlight;
+
+	//per chunk: its data while resident, whether it is being generated, its place in 'lru' and the last frame it was needed
+	vector<shared_ptr<AsteroidChunk>> loaded;
+	vector<bool> requested;
+	vector<list<unsigned int>::iterator> lruEntry;
+	vector<unsigned int> lastNeeded;
+	//resident chunks, most recently needed first
+	list<unsigned int> lru;
+	vector<pair<float, unsigned int>> needed;
+	unsigned int frame;
+	unsigned int inFlight;
+
+	mutex readyMutex;
+	vector<shared_ptr<AsteroidChunk>> ready;
+
+	//field() is 'front', the next one is built into 'back'
+	AsteroidField front;
+	AsteroidField back;
+	//fieldBytes(back) at the last swap, 'back' belongs to the rebuild between swaps
+	size_t backBytes;
+	bool residencyChanged;
+	bool rebuilding;
+	atomic<bool> rebuildDone;
+	bool swapped;
+
+	//declared last, so its destructor waits for the tasks using the members above
+	ThreadPool pool;
+
+	//centre of slice 'slice' of the ring, in its speed's frame
+	glm::vec3 chunkCentre(unsigned int slice) const
+	{
+		float angle = (slice + 0.5f) / slices * glm::two_pi<float>();
+		return glm::vec3(sin(angle) * params.radius, 0.0f, cos(angle) * params.radius);
+	}
+
+	//bytes allocated by a field's instances, bounds and sectors
+	static size_t fieldBytes(const AsteroidField& field)
+	{
+		return field.instances.capacity() * sizeof(AsteroidInstance)
+			+ (field.centreX.capacity() + field.centreY.capacity() + field.centreZ.capacity() + field.radius.capacity()) * sizeof(float)
+			+ field.sectors.capacity() * sizeof(AsteroidSector) + field.groups.capacity() * sizeof(AsteroidSpeedGroup);
+	}
+
+	void request(unsigned int id)
+	{
+		requested[id] = true;
+		inFlight++;
+		pool.submit([this, id]()
+			{
+				shared_ptr<AsteroidChunk> chunk = make_shared<AsteroidChunk>();
+				chunk->id = id;
+				chunk->instances.resize(perChunk);
+				generateAsteroidChunk(seed, params, slices, id, chunk->instances.data());
+
+				lock_guard<mutex> lock(readyMutex);
+				ready.push_back(move(chunk));
+			});
+	}
+
+	void evict(unsigned int id)
+	{
+		lru.erase(lruEntry[id]);
+		//a rebuild in progress may still hold the chunk, it is freed once that is done
+		loaded[id].reset();
+		residencyChanged = true;
+	}
+
+	//merge the resident chunks into 'back' on the pool
+	void rebuild()
+	{
+		vector<shared_ptr<AsteroidChunk>> chunks;
+		for (unsigned int id : lru)
+			chunks.push_back(loaded[id]);
+
+		rebuilding = true;
+		pool.submit([this, chunks]()
+			{
+				//exactly the merged size, so the field never holds more than its chunks
+				size_t total = 0;
+				for (const shared_ptr<AsteroidChunk>& chunk : chunks)
+					total += chunk->instances.size();
+				back.instances.clear();
+				back.instances.shrink_to_fit();
+				back.instances.reserve(total);
+				for (const shared_ptr<AsteroidChunk>& chunk : chunks)
+					back.instances.insert(back.instances.end(), chunk->instances.begin(), chunk->instances.end());
+				back.buildBounds(meshRadius);
+				rebuildDone = true;
+			});
+	}
+};
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+//pick the widest SIMD kernel the compiler targets (/arch:AVX2 on MSVC, -mavx2 on GCC/Clang)
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#define CULL_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SIMD_SSE
+#endif
+
+using namespace std;
+
+//six planes (a, b, c, d) with normals pointing into the frustum
+//order: left, right, bottom, top, near, far
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+//extract the frustum planes from a projection * view matrix (Gribb & Hartmann)
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	//glm is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	//normalise so plane distances are in world units and can be compared with sphere radii
+	for (int i = 0; i < 6; i++)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+	return frustum;
+}
+
+//test one sphere against the frustum
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& centre, float radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		if (glm::dot(glm::vec3(frustum.planes[p]), centre) + frustum.planes[p].w <= -radius)
+			return false;
+	}
+	return true;
+}
+
+//whether the sphere lies completely inside the frustum
+bool sphereInsideFrustum(const Frustum& frustum, const glm::vec3& centre, float radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		if (glm::dot(glm::vec3(frustum.planes[p]), centre) + frustum.planes[p].w < radius)
+			return false;
+	}
+	return true;
+}
+
+//the same frustum in a frame rotated about the y-axis, where world = rotateY(local) with cos 'c' and sin 's'
+//lets spheres stored in that frame be tested without moving them into the world first
+Frustum rotateFrustumY(const Frustum& frustum, float c, float s)
+{
+	Frustum local;
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		local.planes[p] = glm::vec4(c * plane.x - s * plane.z, plane.y, s * plane.x + c * plane.z, plane.w);
+	}
+	return local;
+}
+
+//shadow cone of a sphere occluder (the planet) seen from the camera
+//a sphere is hidden when it lies completely inside the cone and completely behind the plane of the occluder's silhouette
+struct OcclusionCone
+{
+	glm::vec3 eye;
+	//unit vector from the eye to the occluder centre
+	glm::vec3 axis;
+	//sine & cosine of the cone's half angle
+	float sinAngle;
+	float cosAngle;
+	//distance from the eye to the silhouette plane along the axis, FLT_MAX disables the test
+	float planeDistance;
+};
+
+OcclusionCone makeOcclusionCone(const glm::vec3& eye, const glm::vec3& occluderCentre, float occluderRadius)
+{
+	OcclusionCone cone;
+	cone.eye = eye;
+	glm::vec3 toOccluder = occluderCentre - eye;
+	float distance = glm::length(toOccluder);
+	//from inside (or right on) the occluder nothing can be proven hidden
+	if (occluderRadius <= 0.0f || distance <= occluderRadius * 1.001f)
+	{
+		cone.axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		cone.sinAngle = 0.0f;
+		cone.cosAngle = 1.0f;
+		cone.planeDistance = FLT_MAX;
+		return cone;
+	}
+	cone.axis = toOccluder / distance;
+	cone.sinAngle = occluderRadius / distance;
+	cone.cosAngle = sqrt(distance * distance - occluderRadius * occluderRadius) / distance;
+	cone.planeDistance = (distance * distance - occluderRadius * occluderRadius) / distance;
+	return cone;
+}
+
+//no occluder at all
+OcclusionCone noOcclusion()
+{
+	return makeOcclusionCone(glm::vec3(0.0f), glm::vec3(0.0f), 0.0f);
+}
+
+//test one sphere against the shadow cone
+bool sphereOccluded(const OcclusionCone& cone, const glm::vec3& centre, float radius)
+{
+	glm::vec3 v = centre - cone.eye;
+	float along = glm::dot(v, cone.axis);
+	float perp = sqrt(max(glm::dot(v, v) - along * along, 0.0f));
+	//signed distance inside the cone surface must cover the radius, and the sphere must be past the silhouette
+	return along * cone.sinAngle - perp * cone.cosAngle >= radius && along - radius >= cone.planeDistance;
+}
+
+//whether no part of the sphere can be hidden: completely outside the cone or completely in front of the silhouette
+bool sphereUnoccluded(const OcclusionCone& cone, const glm::vec3& centre, float radius)
+{
+	glm::vec3 v = centre - cone.eye;
+	float along = glm::dot(v, cone.axis);
+	float perp = sqrt(max(glm::dot(v, v) - along * along, 0.0f));
+	return perp * cone.cosAngle - along * cone.sinAngle >= radius || along + radius < cone.planeDistance;
+}
+
+//the same cone in a frame rotated about the y-axis, see rotateFrustumY
+OcclusionCone rotateConeY(const OcclusionCone& cone, float c, float s)
+{
+	OcclusionCone local = cone;
+	local.eye = glm::vec3(c * cone.eye.x - s * cone.eye.z, cone.eye.y, s * cone.eye.x + c * cone.eye.z);
+	local.axis = glm::vec3(c * cone.axis.x - s * cone.axis.z, cone.axis.y, s * cone.axis.x + c * cone.axis.z);
+	return local;
+}
+
+//bounding spheres as a structure of arrays, so the kernels load 4/8 of each component at once
+struct SphereArrays
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* radius;
+	unsigned int count;
+};
+
+//a contiguous run of spheres left over after coarser culling (e.g. a sector)
+struct SphereRun
+{
+	unsigned int first;
+	unsigned int count;
+	//index of the frustum & cone to test the run against, expressed in the frame its spheres are stored in
+	unsigned int view;
+	//already known to be entirely visible, so the spheres are taken without testing
+	bool inside;
+};
+
+//test spheres [begin, end) against the frustum and the occlusion cone, and append the indices of the visible ones to 'out',
+//returns how many were written
+//indices are written unconditionally and the output cursor only advances for visible spheres, so compaction has no branches
+unsigned int cullSphereRange(const SphereArrays& spheres, const Frustum& frustum, const OcclusionCone& cone,
+	unsigned int begin, unsigned int end, unsigned int* out)
+{
+	unsigned int written = 0;
+	unsigned int i = begin;
+
+#if defined(CULL_SIMD_AVX)
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 eyeX = _mm256_set1_ps(cone.eye.x), eyeY = _mm256_set1_ps(cone.eye.y), eyeZ = _mm256_set1_ps(cone.eye.z);
+	const __m256 axisX = _mm256_set1_ps(cone.axis.x), axisY = _mm256_set1_ps(cone.axis.y), axisZ = _mm256_set1_ps(cone.axis.z);
+	const __m256 sinAngle = _mm256_set1_ps(cone.sinAngle), cosAngle = _mm256_set1_ps(cone.cosAngle);
+	const __m256 planeDistance = _mm256_set1_ps(cone.planeDistance);
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(spheres.x + i);
+		__m256 y = _mm256_loadu_ps(spheres.y + i);
+		__m256 z = _mm256_loadu_ps(spheres.z + i);
+		__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(spheres.radius + i));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+				_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GT_OQ));
+		}
+
+		//occlusion cone
+		__m256 vx = _mm256_sub_ps(x, eyeX);
+		__m256 vy = _mm256_sub_ps(y, eyeY);
+		__m256 vz = _mm256_sub_ps(z, eyeZ);
+		__m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, axisX), _mm256_mul_ps(vy, axisY)), _mm256_mul_ps(vz, axisZ));
+		__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+		__m256 perp = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(lengthSq, _mm256_mul_ps(along, along)), zero));
+		__m256 coneDistance = _mm256_sub_ps(_mm256_mul_ps(along, sinAngle), _mm256_mul_ps(perp, cosAngle));
+		__m256 occluded = _mm256_and_ps(_mm256_cmp_ps(coneDistance, _mm256_sub_ps(zero, negRadius), _CMP_GE_OQ),
+			_mm256_cmp_ps(_mm256_add_ps(along, negRadius), planeDistance, _CMP_GE_OQ));
+		inside = _mm256_andnot_ps(occluded, inside);
+
+		unsigned int mask = static_cast<unsigned int>(_mm256_movemask_ps(inside));
+		for (unsigned int lane = 0; lane < 8; lane++)
+		{
+			out[written] = i + lane;
+			written += (mask >> lane) & 1u;
+		}
+	}
+#elif defined(CULL_SIMD_SSE)
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 eyeX = _mm_set1_ps(cone.eye.x), eyeY = _mm_set1_ps(cone.eye.y), eyeZ = _mm_set1_ps(cone.eye.z);
+	const __m128 axisX = _mm_set1_ps(cone.axis.x), axisY = _mm_set1_ps(cone.axis.y), axisZ = _mm_set1_ps(cone.axis.z);
+	const __m128 sinAngle = _mm_set1_ps(cone.sinAngle), cosAngle = _mm_set1_ps(cone.cosAngle);
+	const __m128 planeDistance = _mm_set1_ps(cone.planeDistance);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(spheres.x + i);
+		__m128 y = _mm_loadu_ps(spheres.y + i);
+		__m128 z = _mm_loadu_ps(spheres.z + i);
+		__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(spheres.radius + i));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negRadius));
+		}
+
+		//occlusion cone
+		__m128 vx = _mm_sub_ps(x, eyeX);
+		__m128 vy = _mm_sub_ps(y, eyeY);
+		__m128 vz = _mm_sub_ps(z, eyeZ);
+		__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, axisX), _mm_mul_ps(vy, axisY)), _mm_mul_ps(vz, axisZ));
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		__m128 perp = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), zero));
+		__m128 coneDistance = _mm_sub_ps(_mm_mul_ps(along, sinAngle), _mm_mul_ps(perp, cosAngle));
+		__m128 occluded = _mm_and_ps(_mm_cmpge_ps(coneDistance, _mm_sub_ps(zero, negRadius)),
+			_mm_cmpge_ps(_mm_add_ps(along, negRadius), planeDistance));
+		inside = _mm_andnot_ps(occluded, inside);
+
+		unsigned int mask = static_cast<unsigned int>(_mm_movemask_ps(inside));
+		for (unsigned int lane = 0; lane < 4; lane++)
+		{
+			out[written] = i + lane;
+			written += (mask >> lane) & 1u;
+		}
+	}
+#endif
+
+	//scalar tail (or everything, without SIMD)
+	for (; i < end; i++)
+	{
+		glm::vec3 centre(spheres.x[i], spheres.y[i], spheres.z[i]);
+		out[written] = i;
+		written += sphereInFrustum(frustum, centre, spheres.radius[i]) && !sphereOccluded(cone, centre, spheres.radius[i]) ? 1u : 0u;
+	}
+
+	return written;
+}
+
+//splits sphere culling across a thread pool and compacts the survivors into one ordered index list
+class FrustumCuller
+{
+public:
+	//number of spheres per task
+	unsigned int grain;
+
+	FrustumCuller(ThreadPool& pool, unsigned int grain = 4096) : grain(grain), pool(pool)
+	{
+	}
+
+	//writes the indices of all spheres intersecting the frustum and not hidden in the occlusion cone into 'visible', in ascending order
+	void cull(const SphereArrays& spheres, const Frustum& frustum, const OcclusionCone& cone, vector<unsigned int>& visible)
+	{
+		unsigned int chunkCount = (spheres.count + grain - 1) / grain;
+		//each chunk writes into its own slice of the scratch list (it can't produce more indices than its size)
+		scratch.resize(spheres.count);
+		chunkVisible.assign(chunkCount, 0);
+
+		pool.parallelFor(spheres.count, grain, [&](unsigned int begin, unsigned int end)
+			{
+				chunkVisible[begin / grain] = cullSphereRange(spheres, frustum, cone, begin, end, &scratch[begin]);
+			});
+
+		compact(chunkCount, [&](unsigned int c) { return c * grain; }, visible);
+	}
+
+	//the same, but only for the spheres in 'runs' (disjoint and ascending), each tested against its own view
+	//'runVisible' receives where each run's survivors start in 'visible', plus the total at the end
+	void cull(const SphereArrays& spheres, const vector<SphereRun>& runs, const vector<Frustum>& frustums,
+		const vector<OcclusionCone>& cones, vector<unsigned int>& visible, vector<unsigned int>& runVisible)
+	{
+		unsigned int runCount = static_cast<unsigned int>(runs.size());
+		scratch.resize(spheres.count);
+		chunkVisible.assign(runCount, 0);
+
+		//aim for about 'grain' spheres per task
+		unsigned int runGrain = 1;
+		if (runCount > 0)
+			runGrain = max(1u, grain * runCount / max(1u, runs.back().first + runs.back().count - runs.front().first));
+
+		pool.parallelFor(runCount, runGrain, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int r = begin; r < end; r++)
+				{
+					const SphereRun& run = runs[r];
+					unsigned int* out = &scratch[run.first];
+					if (run.inside)
+					{
+						for (unsigned int i = 0; i < run.count; i++)
+							out[i] = run.first + i;
+						chunkVisible[r] = run.count;
+					}
+					else
+					{
+						chunkVisible[r] = cullSphereRange(spheres, frustums[run.view], cones[run.view], run.first, run.first + run.count, out);
+					}
+				}
+			});
+
+		compact(runCount, [&](unsigned int r) { return runs[r].first; }, visible);
+		runVisible.assign(chunkOffsets.begin(), chunkOffsets.end());
+		runVisible.push_back(static_cast<unsigned int>(visible.size()));
+	}
+
+private:
+	ThreadPool& pool;
+	vector<unsigned int> scratch;
+	vector<unsigned int> chunkVisible;
+	vector<unsigned int> chunkOffsets;
+
+	//gather the per-chunk results from their scratch slices into one list
+	template <typename ScratchStart>
+	void compact(unsigned int chunkCount, ScratchStart scratchStart, vector<unsigned int>& visible)
+	{
+		//prefix sum of the per-chunk counts gives every chunk its place in the compacted list
+		chunkOffsets.resize(chunkCount);
+		unsigned int total = 0;
+		for (unsigned int c = 0; c < chunkCount; c++)
+		{
+			chunkOffsets[c] = total;
+			total += chunkVisible[c];
+		}
+
+		visible.resize(total);
+		pool.parallelFor(chunkCount, 16, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int c = begin; c < end; c++)
+				{
+					if (chunkVisible[c] > 0)
+						memcpy(&visible[chunkOffsets[c]], &scratch[scratchStart(c)], chunkVisible[c] * sizeof(unsigned int));
+				}
+			});
+	}
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace std;
+
+//range of a mesh inside a GeometryArena
+struct GeometryRange
+{
+	//first vertex, passed as basevertex to glDraw*BaseVertex
+	int baseVertex;
+	//byte offset of the first index
+	size_t indexByteOffset;
+};
+
+//one vertex buffer & one index buffer shared by every mesh of a vertex format, with a single VAO over them
+//meshes get consecutive ranges and draw with glDrawElements*BaseVertex, so switching meshes needs no VAO bind
+//the buffers grow (copied on the GPU) as meshes are added, the VAO and ranges handed out stay valid
+class GeometryArena
+{
+public:
+	unsigned int VAO;
+
+	//'stride' bytes per vertex, 'setupLayout' points the attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+	GeometryArena(unsigned int stride, void (*setupLayout)())
+		: VAO(0), stride(stride), setupLayout(setupLayout), VBO(0), EBO(0),
+		vertexCapacity(0), vertexCount(0), indexCapacity(0), indexBytes(0)
+	{
+	}
+
+	//reserve 'vertices' vertices and 'bytes' bytes of indices
+	//leaves the VAO and vertex buffer bound, ready for glBufferSubData or glMapBufferRange at the range
+	GeometryRange allocate(size_t vertices, size_t bytes)
+	{
+		if (VAO == 0)
+			glGenVertexArrays(1, &VAO);
+		//index ranges start 4-byte aligned, so both index types can address them with firstIndex
+		size_t indexStart = (indexBytes + 3) & ~size_t(3);
+		reserve(vertexCount + vertices, indexStart + bytes);
+
+		GeometryRange range = { static_cast<int>(vertexCount), indexStart };
+		vertexCount += vertices;
+		indexBytes = indexStart + bytes;
+		bind();
+		return range;
+	}
+
+	//bind the VAO (and with it the index buffer) and the vertex buffer
+	void bind() const
+	{
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	}
+
+	//byte offset of vertex 'baseVertex' in the vertex buffer
+	size_t vertexByteOffset(int baseVertex) const { return static_cast<size_t>(baseVertex) * stride; }
+
+	//bytes in use, vertices & indices
+	size_t usedBytes() const { return vertexCount * stride + indexBytes; }
+
+private:
+	unsigned int stride;
+	void (*setupLayout)();
+	unsigned int VBO, EBO;
+	//in vertices
+	size_t vertexCapacity, vertexCount;
+	//in bytes
+	size_t indexCapacity, indexBytes;
+
+	//grow the buffers to hold at least 'vertices' vertices & 'bytes' bytes of indices, at least doubling each time
+	void reserve(size_t vertices, size_t bytes)
+	{
+		const size_t minimumBytes = 1 << 20;
+		glBindVertexArray(VAO);
+		if (vertices > vertexCapacity || VBO == 0)
+		{
+			size_t capacity = max(max(vertices, vertexCapacity * 2), minimumBytes / stride);
+			VBO = grow(GL_ARRAY_BUFFER, VBO, vertexCount * stride, capacity * stride);
+			vertexCapacity = capacity;
+			//the attributes still point at the old buffer
+			setupLayout();
+		}
+		if (bytes > indexCapacity || EBO == 0)
+		{
+			size_t capacity = max(max(bytes, indexCapacity * 2), minimumBytes);
+			EBO = grow(GL_ELEMENT_ARRAY_BUFFER, EBO, indexBytes, capacity);
+			indexCapacity = capacity;
+		}
+	}
+
+	//new buffer of 'capacity' bytes holding the first 'used' bytes of 'buffer', which is deleted
+	//it is left bound to 'target' (GL_ELEMENT_ARRAY_BUFFER binds into the bound VAO)
+	unsigned int grow(GLenum target, unsigned int buffer, size_t used, size_t capacity)
+	{
+		unsigned int grown;
+		glGenBuffers(1, &grown);
+		glBindBuffer(target, grown);
+		glBufferData(target, capacity, NULL, GL_STATIC_DRAW);
+		if (buffer != 0)
+		{
+			if (used > 0)
+			{
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, target, 0, 0, used);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		return grown;
+	}
+};
+
+#endif
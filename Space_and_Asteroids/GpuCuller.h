@@ -0,0 +1,331 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Shader.h>
+#include <Model.h>
+#include <AsteroidField.h>
+#include <FrustumCuller.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+//layout of one glDrawElementsIndirect command
+struct DrawElementsIndirectCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+//layout of one glDrawArraysIndirect command
+struct DrawArraysIndirectCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int first;
+	unsigned int baseInstance;
+};
+
+//frustum culling of asteroid instances on the GPU (GL 3.3)
+//a vertex shader tests every instance with rasterisation discarded, and a geometry shader emits only the visible ones
+//into a transform feedback buffer, which the asteroid draw then uses as its instance stream
+//the instance count comes from a GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query: written straight into an indirect draw
+//command on GL 4.4, otherwise read back one frame late so the CPU never waits for the GPU
+//instances hidden behind the planet are dropped in the same test, and levels of detail are selected there too,
+//each level (and the impostor tier after them) compacting into its own stream
+class GpuCuller
+{
+public:
+	GpuCuller(Shader& cullShader, const vector<AsteroidInstance>& instances, Model& model, unsigned int slots = 3)
+		: shader(cullShader), count(static_cast<unsigned int>(instances.size())), slots(slots), levels(1), frame(0), drawSlot(0),
+		indirect(GLAD_GL_VERSION_4_4 != 0), indirectBuffer(0), meshCount(static_cast<unsigned int>(model.meshes.size()))
+	{
+		for (unsigned int i = 0; i < meshCount; i++)
+			levels = max(levels, static_cast<unsigned int>(model.meshes[i].lods.size()));
+		streams = levels + 1;
+		drawCounts.assign(streams, 0);
+
+		uniforms.frustumPlanes = shader.uniform<glm::vec4>("frustumPlanes");
+		uniforms.meshRadius = shader.uniform<float>("meshRadius");
+		uniforms.occlusionAxis = shader.uniform<glm::vec3>("occlusionAxis");
+		uniforms.occlusionCone = shader.uniform<glm::vec3>("occlusionCone");
+		uniforms.lodPixelScale = shader.uniform<float>("lodPixelScale");
+		uniforms.lodReference = shader.uniform<float>("lodReference");
+		uniforms.lodBias = shader.uniform<float>("lodBias");
+		uniforms.impostorDistance = shader.uniform<float>("impostorDistance");
+		uniforms.lodLevel = shader.uniform<int>("lodLevel");
+		//constant for the culler's lifetime
+		shader.use();
+		//the late-read path draws last frame's result, so give the spheres some slack for camera movement
+		shader.uniform<float>("cullSlack").set(indirect ? 1.0f : 1.1f);
+		shader.uniform<int>("lodLevels").set(static_cast<int>(levels));
+
+		//all instances, read once per level each frame by the cull pass
+		glGenBuffers(1, &sourceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, sourceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(AsteroidInstance), instances.data(), GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &cullVAO);
+		glBindVertexArray(cullVAO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)offsetof(AsteroidInstance, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribIPointer(1, 3, GL_UNSIGNED_INT, sizeof(AsteroidInstance), (void*)offsetof(AsteroidInstance, scale));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)offsetof(AsteroidInstance, scale));
+		glBindVertexArray(0);
+
+		//one output buffer and query per slot and stream, so the buffer being drawn is never the one being written
+		unsigned int outputs = slots * streams;
+		feedbackBuffers.resize(outputs);
+		queries.resize(outputs);
+		glGenBuffers(outputs, feedbackBuffers.data());
+		glGenQueries(outputs, queries.data());
+		for (unsigned int i = 0; i < outputs; i++)
+		{
+			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackBuffers[i]);
+			glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, count * sizeof(AsteroidInstance), NULL, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (indirect)
+		{
+			//one command per level and mesh, meshes with fewer levels repeat their coarsest one
+			vector<DrawElementsIndirectCommand> commands(levels * meshCount);
+			for (unsigned int l = 0; l < levels; l++)
+			{
+				for (unsigned int i = 0; i < meshCount; i++)
+				{
+					const MeshLod& lod = meshLod(model.meshes[i], l);
+					commands[l * meshCount + i] = { lod.indexCount, 0, model.meshes[i].arenaFirstIndex(lod), model.meshes[i].baseVertex, 0 };
+				}
+			}
+			//followed by the impostor quads' array command
+			DrawArraysIndirectCommand impostorCommand = { 4, 0, 0, 0 };
+			GLsizeiptr commandsSize = commands.size() * sizeof(DrawElementsIndirectCommand);
+
+			glGenBuffers(1, &indirectBuffer);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commandsSize + sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandsSize, commands.data());
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, commandsSize, sizeof(DrawArraysIndirectCommand), &impostorCommand);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+	}
+
+	unsigned int lodLevels() const { return levels; }
+
+	bool usesIndirect() const { return indirect; }
+
+	//run the cull pass for this frame, 'time' is the asteroid shader's uTime
+	//only the instances in 'runs' (the sectors that survived AsteroidField::cullSectors) are read
+	//every level of detail gets its own pass and output stream
+	//time & camera position come from the FrameData block, which must be up to date
+	void cull(const vector<SphereRun>& runs, const Frustum& frustum, const OcclusionCone& cone, float meshRadius, const LodSettings& lod)
+	{
+		unsigned int slot = frame % slots;
+
+		//neighbouring runs merge into one range of the source buffer
+		runFirsts.clear();
+		runCounts.clear();
+		for (const SphereRun& run : runs)
+		{
+			if (!runFirsts.empty() && static_cast<unsigned int>(runFirsts.back() + runCounts.back()) == run.first)
+			{
+				runCounts.back() += run.count;
+			}
+			else
+			{
+				runFirsts.push_back(static_cast<GLint>(run.first));
+				runCounts.push_back(static_cast<GLsizei>(run.count));
+			}
+		}
+
+		shader.use();
+		uniforms.frustumPlanes.set(frustum.planes, 6);
+		uniforms.meshRadius.set(meshRadius);
+		uniforms.occlusionAxis.set(cone.axis);
+		uniforms.occlusionCone.set(glm::vec3(cone.sinAngle, cone.cosAngle, cone.planeDistance));
+		uniforms.lodPixelScale.set(lod.pixelScale);
+		uniforms.lodReference.set(lod.referencePixels);
+		uniforms.lodBias.set(lod.bias);
+		uniforms.impostorDistance.set(lod.impostorDistance);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindVertexArray(cullVAO);
+		for (unsigned int l = 0; l < streams; l++)
+		{
+			unsigned int output = slot * streams + l;
+			uniforms.lodLevel.set(static_cast<int>(l));
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackBuffers[output]);
+			glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[output]);
+			glBeginTransformFeedback(GL_POINTS);
+			if (!runFirsts.empty())
+				glMultiDrawArrays(GL_POINTS, runFirsts.data(), runCounts.data(), static_cast<GLsizei>(runFirsts.size()));
+			glEndTransformFeedback();
+			glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		}
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glBindVertexArray(0);
+		glDisable(GL_RASTERIZER_DISCARD);
+
+		if (indirect)
+		{
+			//the GPU copies each level's query result into the instanceCount of its commands, no CPU round trip
+			glBindBuffer(GL_QUERY_BUFFER, indirectBuffer);
+			for (unsigned int l = 0; l < levels; l++)
+			{
+				for (unsigned int i = 0; i < meshCount; i++)
+				{
+					GLintptr field = (l * meshCount + i) * sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instanceCount);
+					glGetQueryObjectuiv(queries[slot * streams + l], GL_QUERY_RESULT, (GLuint*)field);
+				}
+			}
+			GLintptr impostorField = impostorCommandOffset() + offsetof(DrawArraysIndirectCommand, instanceCount);
+			glGetQueryObjectuiv(queries[slot * streams + levels], GL_QUERY_RESULT, (GLuint*)impostorField);
+			glBindBuffer(GL_QUERY_BUFFER, 0);
+			drawSlot = slot;
+		}
+		else if (frame > 0)
+		{
+			//draw the newest earlier result that is already available, only waiting if the GPU is two frames behind
+			//the last stream's query finishes last, so it stands for the whole slot
+			unsigned int previous = (slot + slots - 1) % slots;
+			GLuint available = 0;
+			glGetQueryObjectuiv(queries[previous * streams + streams - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available && frame > 1)
+				previous = (slot + slots - 2) % slots;
+			for (unsigned int l = 0; l < streams; l++)
+				glGetQueryObjectuiv(queries[previous * streams + l], GL_QUERY_RESULT, &drawCounts[l]);
+			drawSlot = previous;
+		}
+
+		frame++;
+	}
+
+	//draw the model with the culled instances, one instanced draw per level and mesh
+	//the meshes share their arena's VAO, so the instance attributes are only re-pointed once per level
+	void draw(Model& model, Shader& shader)
+	{
+		if (indirect)
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+		for (unsigned int l = 0; l < levels; l++)
+		{
+			if (!indirect && drawCounts[l] == 0)
+				continue;
+			unsigned int attached = 0;
+			for (unsigned int i = 0; i < model.meshes.size(); i++)
+			{
+				Mesh& mesh = model.meshes[i];
+				if (mesh.VAO != attached)
+				{
+					setupAsteroidInstanceAttributes(mesh.VAO, feedbackBuffers[drawSlot * streams + l], 0);
+					attached = mesh.VAO;
+					glBindVertexArray(mesh.VAO);
+				}
+				mesh.setPositionDecode(shader);
+				if (indirect)
+				{
+					glDrawElementsIndirect(GL_TRIANGLES, mesh.indexType, (void*)((l * meshCount + i) * sizeof(DrawElementsIndirectCommand)));
+				}
+				else
+				{
+					const MeshLod& lod = meshLod(mesh, l);
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, mesh.indexType, mesh.indexOffset(lod), drawCounts[l],
+						mesh.baseVertex);
+				}
+			}
+		}
+		glBindVertexArray(0);
+
+		if (indirect)
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	//draw the impostor tier as instanced quads, the impostor shader and atlas must already be bound
+	void drawImpostors(unsigned int quadVAO)
+	{
+		if (!indirect && drawCounts[levels] == 0)
+			return;
+
+		setupAsteroidInstanceAttributes(quadVAO, feedbackBuffers[drawSlot * streams + levels], 0);
+		glBindVertexArray(quadVAO);
+		if (indirect)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)impostorCommandOffset());
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else
+		{
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, drawCounts[levels]);
+		}
+		glBindVertexArray(0);
+	}
+
+	//free the GL objects, must be called while the context is still alive
+	void release()
+	{
+		glDeleteBuffers(1, &sourceBuffer);
+		glDeleteBuffers(static_cast<GLsizei>(feedbackBuffers.size()), feedbackBuffers.data());
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+		glDeleteVertexArrays(1, &cullVAO);
+		if (indirectBuffer)
+			glDeleteBuffers(1, &indirectBuffer);
+	}
+
+private:
+	Shader& shader;
+	//cull pass uniforms set every frame
+	struct CullUniforms
+	{
+		UniformHandle<glm::vec4> frustumPlanes;
+		UniformHandle<float> meshRadius, lodPixelScale, lodReference, lodBias, impostorDistance;
+		UniformHandle<glm::vec3> occlusionAxis, occlusionCone;
+		UniformHandle<int> lodLevel;
+	} uniforms;
+	unsigned int count;
+	unsigned int slots;
+	//levels of detail of the model (the most any of its meshes has)
+	unsigned int levels;
+	//output streams per slot: the levels, then the impostor tier
+	unsigned int streams;
+	unsigned int frame;
+	unsigned int drawSlot;
+	//per stream instance counts of the late-read path
+	vector<GLuint> drawCounts;
+	bool indirect;
+
+	unsigned int sourceBuffer;
+	unsigned int cullVAO;
+	unsigned int indirectBuffer;
+	unsigned int meshCount;
+	//indexed by slot * streams + stream
+	vector<unsigned int> feedbackBuffers;
+	vector<unsigned int> queries;
+	//source ranges of this frame's cull pass
+	vector<GLint> runFirsts;
+	vector<GLsizei> runCounts;
+
+	GLintptr impostorCommandOffset() const
+	{
+		return levels * meshCount * sizeof(DrawElementsIndirectCommand);
+	}
+
+	static const MeshLod& meshLod(const Mesh& mesh, unsigned int level)
+	{
+		return mesh.lods[min(level, static_cast<unsigned int>(mesh.lods.size()) - 1)];
+	}
+};
+
+#endif
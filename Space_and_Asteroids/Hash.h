@@ -0,0 +1,41 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <MappedFile.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+const uint64_t fnvOffsetBasis = 14695981039346656037ull;
+
+//64-bit FNV-1a, chain calls by passing the previous result as 'hash'
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = fnvOffsetBasis)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t hashString(const string& text, uint64_t hash = fnvOffsetBasis)
+{
+	return hashBytes(text.data(), text.size(), hash);
+}
+
+//hash of a file's contents, false if it can't be read
+bool hashFile(const string& path, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	hash = hashBytes(file.data(), file.size(), hash);
+	return true;
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef IMPOSTOR_ATLAS_H
+#define IMPOSTOR_ATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Shader.h>
+#include <Model.h>
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+//map a point of the [-1, 1] octahedral square back to a unit direction (y is the octahedron's pole)
+//must match octDecode in impostor.vertex
+glm::vec3 octDecode(const glm::vec2& p)
+{
+	glm::vec3 n(p.x, 1.0f - fabs(p.x) - fabs(p.y), p.y);
+	if (n.y < 0.0f)
+	{
+		float x = (1.0f - fabs(n.z)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		float z = (1.0f - fabs(n.x)) * (n.z >= 0.0f ? 1.0f : -1.0f);
+		n.x = x;
+		n.z = z;
+	}
+	return glm::normalize(n);
+}
+
+//right & up axes of the view looking at the model from 'forward' (model -> viewer)
+//must match frameBasis in impostor.vertex
+void impostorFrameBasis(const glm::vec3& forward, glm::vec3& right, glm::vec3& up)
+{
+	glm::vec3 reference = fabs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	right = glm::normalize(glm::cross(reference, forward));
+	up = glm::cross(forward, right);
+}
+
+//octahedral impostor of a model: 'frames' x 'frames' orthographic views from directions spread over the whole sphere
+//baked once into an albedo atlas (alpha = coverage) and a normal & depth atlas (view-space normal, depth in alpha),
+//so a single camera-facing quad can stand in for the mesh and still be lit by a moving light
+class ImpostorAtlas
+{
+public:
+	unsigned int albedoTexture;
+	unsigned int normalDepthTexture;
+	//quad VAO, corners come from gl_VertexID and the instance attributes are attached per draw
+	unsigned int VAO;
+	unsigned int frames;
+	unsigned int frameSize;
+	//half extent of every frame, in model units
+	float radius;
+
+	//render the model from every atlas direction, 'bakeShader' is impostorBake.vertex/.fragment
+	ImpostorAtlas(Model& model, Shader& bakeShader, unsigned int frames = 8, unsigned int frameSize = 128)
+		: frames(frames), frameSize(frameSize), radius(model.boundingRadius)
+	{
+		unsigned int size = frames * frameSize;
+		//stop mipmapping before a frame shrinks to a few texels, below that neighbouring frames bleed together
+		int maxLevel = 0;
+		while ((frameSize >> maxLevel) > 8)
+			maxLevel++;
+
+		albedoTexture = createAtlasTexture(size, maxLevel);
+		normalDepthTexture = createAtlasTexture(size, maxLevel);
+
+		unsigned int FBO, depthRBO;
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthTexture, 0);
+		glGenRenderbuffers(1, &depthRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+		unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, attachments);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "ERROR::FRAMEBUFFER:: Impostor framebuffer is not complete!" << endl;
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		bakeShader.use();
+		bakeShader.setFloat("radius", radius);
+		for (unsigned int y = 0; y < frames; y++)
+		{
+			for (unsigned int x = 0; x < frames; x++)
+			{
+				//every frame looks at the model from the direction at the centre of its octahedral cell
+				glm::vec2 cell((x + 0.5f) / frames * 2.0f - 1.0f, (y + 0.5f) / frames * 2.0f - 1.0f);
+				glm::vec3 forward = octDecode(cell);
+				glm::vec3 right, up;
+				impostorFrameBasis(forward, right, up);
+
+				glViewport(x * frameSize, y * frameSize, frameSize, frameSize);
+				bakeShader.setVec3("frameRight", right);
+				bakeShader.setVec3("frameUp", up);
+				bakeShader.setVec3("frameForward", forward);
+				model.Draw(bakeShader);
+			}
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glDeleteRenderbuffers(1, &depthRBO);
+		glDeleteFramebuffers(1, &FBO);
+
+		glBindTexture(GL_TEXTURE_2D, albedoTexture);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenVertexArrays(1, &VAO);
+	}
+
+	//set the impostor shader's atlas uniforms, they don't change after baking ('shader' must be in use)
+	void setUniforms(Shader& shader)
+	{
+		shader.uniform<int>("impostorAlbedo").set(0);
+		shader.uniform<int>("impostorNormalDepth").set(1);
+		shader.uniform<int>("impostorFrames").set(static_cast<int>(frames));
+		shader.uniform<float>("impostorRadius").set(radius);
+	}
+
+	//bind the atlases to texture units 0 & 1
+	void bind()
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, albedoTexture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//free the GL objects, must be called while the context is still alive
+	void release()
+	{
+		glDeleteTextures(1, &albedoTexture);
+		glDeleteTextures(1, &normalDepthTexture);
+		glDeleteVertexArrays(1, &VAO);
+	}
+
+private:
+	static unsigned int createAtlasTexture(unsigned int size, int maxLevel)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+};
+
+#endif
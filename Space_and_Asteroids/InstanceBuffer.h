@@ -0,0 +1,252 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//streaming buffer for per-instance vertex attributes
+//the GL buffer is split into a ring of 'frames' regions, one per frame in flight, each guarded by a fence
+//the CPU keeps a copy of every instance and only writes the ranges that changed since a region was last used
+//uses a persistently mapped store when GL 4.4 is available, otherwise orphaning and unsynchronised mapping
+template <typename T>
+class InstanceBuffer
+{
+public:
+	//buffer object id
+	unsigned int ID;
+
+	//constructor
+	//'capacity' is the maximum number of instances, 'frames' is the length of the ring
+	InstanceBuffer(unsigned int capacity, unsigned int frames = 3)
+		: ID(0), capacity(capacity), count(0), frames(frames), current(0), persistent(GLAD_GL_VERSION_4_4 != 0), mapped(nullptr)
+	{
+		instances.resize(capacity);
+		fences.assign(frames, nullptr);
+		dirtyBegin.assign(frames, 0);
+		dirtyEnd.assign(frames, 0);
+		lost.assign(frames, false);
+
+		regionSize = static_cast<GLsizeiptr>(capacity) * sizeof(T);
+
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_ARRAY_BUFFER, ID);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, regionSize * frames, NULL, flags);
+			mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * frames, flags));
+			if (!mapped)
+			{
+				cout << "ERROR::INSTANCE_BUFFER::PERSISTENT_MAPPING_FAILED, falling back to orphaning" << endl;
+				persistent = false;
+				//immutable storage can't be orphaned, so start over with a mutable buffer
+				glDeleteBuffers(1, &ID);
+				glGenBuffers(1, &ID);
+				glBindBuffer(GL_ARRAY_BUFFER, ID);
+			}
+		}
+		if (!persistent)
+			glBufferData(GL_ARRAY_BUFFER, regionSize * frames, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//number of live instances, the instance count to draw with
+	unsigned int size() const { return count; }
+	unsigned int maxSize() const { return capacity; }
+	bool isPersistent() const { return persistent; }
+
+	//change the number of live instances (up to capacity)
+	void resize(unsigned int newCount)
+	{
+		newCount = min(newCount, capacity);
+		if (newCount > count)
+			markDirty(count, newCount - count);
+		count = newCount;
+	}
+
+	//CPU-side copy of the instances
+	//callers writing through data() directly must call markDirty() for the range they touched
+	T* data() { return instances.data(); }
+	const T& get(unsigned int index) const { return instances[index]; }
+
+	void set(unsigned int index, const T& value)
+	{
+		instances[index] = value;
+		markDirty(index, 1);
+	}
+
+	//write a contiguous block of instances starting at 'first'
+	void write(unsigned int first, const T* values, unsigned int n)
+	{
+		memcpy(&instances[first], values, n * sizeof(T));
+		markDirty(first, n);
+	}
+
+	//a changed range has to reach every region of the ring, so it is merged into the pending range of all of them
+	void markDirty(unsigned int first, unsigned int n)
+	{
+		if (n == 0)
+			return;
+		unsigned int last = min(first + n, capacity);
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			if (dirtyBegin[i] == dirtyEnd[i])
+			{
+				dirtyBegin[i] = first;
+				dirtyEnd[i] = last;
+			}
+			else
+			{
+				dirtyBegin[i] = min(dirtyBegin[i], first);
+				dirtyEnd[i] = max(dirtyEnd[i], last);
+			}
+		}
+	}
+
+	//make the current region up to date before drawing from it
+	//waits only if the GPU is still reading the region from 'frames' frames ago
+	void beginFrame()
+	{
+		unsigned int first = dirtyBegin[current];
+		unsigned int last = min(dirtyEnd[current], count);
+		dirtyBegin[current] = dirtyEnd[current] = 0;
+		if (lost[current])
+		{
+			//the region went with an orphaned store: rewrite it once in full (which covers the pending range too),
+			//into the new store the GPU hasn't read from yet, so neither orphaning nor waiting is needed
+			lost[current] = false;
+			if (count > 0)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, ID);
+				glBufferSubData(GL_ARRAY_BUFFER, current * regionSize, static_cast<GLsizeiptr>(count) * sizeof(T), &instances[0]);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+			return;
+		}
+		if (first >= last)
+			return;
+
+		GLintptr regionOffset = current * regionSize;
+		GLintptr rangeOffset = regionOffset + static_cast<GLintptr>(first) * sizeof(T);
+		GLsizeiptr rangeSize = static_cast<GLsizeiptr>(last - first) * sizeof(T);
+
+		if (persistent)
+		{
+			waitForRegion(current);
+			memcpy(mapped + rangeOffset, &instances[first], rangeSize);
+			return;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, ID);
+		if (first == 0 && last == count)
+		{
+			//everything changed (e.g. a compacted visible list): orphan the whole store instead of waiting for the GPU
+			//the other regions lose their contents with it, each is rewritten once when it next becomes current
+			glBufferData(GL_ARRAY_BUFFER, regionSize * frames, NULL, GL_STREAM_DRAW);
+			for (unsigned int i = 0; i < frames; i++)
+			{
+				if (fences[i])
+				{
+					glDeleteSync(fences[i]);
+					fences[i] = nullptr;
+				}
+				if (i != current)
+				{
+					lost[i] = true;
+					dirtyBegin[i] = dirtyEnd[i] = 0;
+				}
+			}
+		}
+		else
+		{
+			waitForRegion(current);
+		}
+
+		void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, rangeOffset, rangeSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (ptr)
+		{
+			memcpy(ptr, &instances[first], rangeSize);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		else
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, rangeOffset, rangeSize, &instances[first]);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//byte offset of the region the GPU reads this frame, add it to the instance attribute offsets
+	GLintptr offset() const
+	{
+		return current * regionSize;
+	}
+
+	//call after the last draw reading this frame's region
+	void endFrame()
+	{
+		if (fences[current])
+			glDeleteSync(fences[current]);
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current = (current + 1) % frames;
+	}
+
+	//free the GL objects, must be called while the context is still alive
+	void release()
+	{
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+		if (persistent && mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, ID);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &ID);
+		ID = 0;
+	}
+
+private:
+	unsigned int capacity;
+	unsigned int count;
+	unsigned int frames;
+	unsigned int current;
+	bool persistent;
+	unsigned char* mapped;
+	GLsizeiptr regionSize;
+
+	vector<T> instances;
+	vector<GLsync> fences;
+	//pending [begin, end) instance range of each region
+	vector<unsigned int> dirtyBegin;
+	vector<unsigned int> dirtyEnd;
+	//regions whose contents were dropped by orphaning the store (kept apart from the callers' dirty ranges, so
+	//rewriting them doesn't look like a full change and orphan the store again)
+	vector<bool> lost;
+
+	void waitForRegion(unsigned int region)
+	{
+		if (!fences[region])
+			return;
+		GLenum result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		if (result == GL_WAIT_FAILED)
+			cout << "ERROR::INSTANCE_BUFFER::FENCE_WAIT_FAILED" << endl;
+		glDeleteSync(fences[region]);
+		fences[region] = nullptr;
+	}
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+//read-only memory mapping of a whole file
+//the OS pages the file in on first touch, so opening costs next to nothing whatever the file size
+class MappedFile
+{
+public:
+	MappedFile() : bytes(nullptr), length(0)
+	{
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		descriptor = -1;
+#endif
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//map 'path', false if it doesn't exist, is empty or can't be mapped
+	bool open(const string& path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
+		bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			return false;
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+		{
+			close();
+			return false;
+		}
+		length = static_cast<size_t>(status.st_size);
+		void* view = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		bytes = view == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(view);
+#endif
+		if (!bytes)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes)
+			munmap(const_cast<unsigned char*>(bytes), length);
+		if (descriptor >= 0)
+			::close(descriptor);
+		descriptor = -1;
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const { return bytes != nullptr; }
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* bytes;
+	size_t length;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int descriptor;
+#endif
+};
+
+#endif
@@ -4,9 +4,17 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <Shader.h>
+#include <VertexLayout.h>
+#include <GeometryArena.h>
+#include <TextureStreamer.h>
 
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -28,6 +36,13 @@ struct Vertex
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+//index range of one level of detail inside the mesh's index buffer
+struct MeshLod
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
+
 struct Texture
 {
 	unsigned int id;
@@ -35,6 +50,174 @@ struct Texture
 	string path;
 };
 
+//layout of the vertex buffer uploaded to the GPU, chosen per model
+//the shaders only read position, normal and texture coordinates (locations 0-2), so the slim formats drop the rest
+enum VertexFormat
+{
+	//the whole Vertex struct, 88 bytes
+	VERTEX_FORMAT_FULL,
+	//float position, 10_10_10_2 normal, half-float texture coordinates: 20 bytes
+	VERTEX_FORMAT_COMPACT,
+	//16-bit position relative to the mesh's bounding box, 10_10_10_2 normal, half-float texture coordinates: 16 bytes
+	VERTEX_FORMAT_QUANTIZED
+};
+
+struct CompactVertex
+{
+	glm::vec3 Position;
+	//snorm 10_10_10_2
+	uint32_t Normal;
+	//half floats
+	uint16_t texCoords[2];
+};
+
+struct QuantizedVertex
+{
+	//unorm16, the fourth one only pads to 8 bytes
+	uint16_t Position[4];
+	uint32_t Normal;
+	uint16_t texCoords[2];
+};
+
+//attribute layouts of the formats, checked against the structs they describe
+using FullVertexLayout = VertexLayout<Pos3f, Normal3f, UV2f, Tangent3f, Bitangent3f, BoneIds4i, BoneWeights4f>;
+using CompactVertexLayout = VertexLayout<Pos3f, NormalPacked, UV2h>;
+using QuantizedVertexLayout = VertexLayout<Pos3u16, NormalPacked, UV2h>;
+static_assert(FullVertexLayout::stride == sizeof(Vertex) && FullVertexLayout::offset(2) == offsetof(Vertex, texCoords)
+	&& FullVertexLayout::offset(5) == offsetof(Vertex, m_BoneIDs) && FullVertexLayout::offset(6) == offsetof(Vertex, m_Weights),
+	"FullVertexLayout doesn't match Vertex");
+static_assert(CompactVertexLayout::stride == sizeof(CompactVertex) && CompactVertexLayout::offset(1) == offsetof(CompactVertex, Normal)
+	&& CompactVertexLayout::offset(2) == offsetof(CompactVertex, texCoords), "CompactVertexLayout doesn't match CompactVertex");
+static_assert(QuantizedVertexLayout::stride == sizeof(QuantizedVertex) && QuantizedVertexLayout::offset(1) == offsetof(QuantizedVertex, Normal)
+	&& QuantizedVertexLayout::offset(2) == offsetof(QuantizedVertex, texCoords), "QuantizedVertexLayout doesn't match QuantizedVertex");
+
+//the arena every mesh of 'format' lives in, created on first use
+GeometryArena& geometryArena(VertexFormat format)
+{
+	static GeometryArena arenas[] = {
+		GeometryArena(FullVertexLayout::stride, [] { FullVertexLayout::setup(); }),
+		GeometryArena(CompactVertexLayout::stride, [] { CompactVertexLayout::setup(); }),
+		GeometryArena(QuantizedVertexLayout::stride, [] { QuantizedVertexLayout::setup(); })
+	};
+	return arenas[format];
+}
+
+//vertex & index buffers of a mesh in their GPU layout
+struct MeshBuffers
+{
+	VertexFormat format;
+	vector<unsigned char> vertexData;
+	//GL_UNSIGNED_SHORT when every vertex can be addressed with 16 bits, otherwise GL_UNSIGNED_INT
+	GLenum indexType;
+	vector<unsigned char> indexData;
+	//quantized positions decode as positionOffset + positionScale * position
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+};
+
+uint32_t packVertexNormal(const glm::vec3& normal)
+{
+	return glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+}
+
+//bytes per vertex of a format
+unsigned int vertexFormatSize(VertexFormat format)
+{
+	if (format == VERTEX_FORMAT_COMPACT)
+		return sizeof(CompactVertex);
+	if (format == VERTEX_FORMAT_QUANTIZED)
+		return sizeof(QuantizedVertex);
+	return sizeof(Vertex);
+}
+
+//the slim formats take 16-bit indices when the vertex count allows
+GLenum chooseIndexType(VertexFormat format, size_t vertexCount)
+{
+	return format != VERTEX_FORMAT_FULL && vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+//decoding of the positions of 'vertices' in 'format': the bounding box for quantized positions, identity otherwise
+void positionQuantization(const vector<Vertex>& vertices, VertexFormat format, glm::vec3& offset, glm::vec3& scale)
+{
+	offset = glm::vec3(0.0f);
+	scale = glm::vec3(1.0f);
+	if (format != VERTEX_FORMAT_QUANTIZED || vertices.empty())
+		return;
+
+	glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+	for (const Vertex& vertex : vertices)
+	{
+		low = glm::min(low, vertex.Position);
+		high = glm::max(high, vertex.Position);
+	}
+	offset = low;
+	//flat boxes keep a non-zero scale, so decoding never divides by zero
+	scale = glm::max(high - low, glm::vec3(1e-6f));
+}
+
+//write 'vertices' to 'out' in 'format', 'out' holds vertices.size() * vertexFormatSize(format) bytes
+void encodeVertices(const vector<Vertex>& vertices, VertexFormat format, const glm::vec3& offset, const glm::vec3& scale, void* out)
+{
+	if (format == VERTEX_FORMAT_FULL)
+	{
+		if (!vertices.empty())
+			memcpy(out, vertices.data(), vertices.size() * sizeof(Vertex));
+	}
+	else if (format == VERTEX_FORMAT_COMPACT)
+	{
+		CompactVertex* compact = static_cast<CompactVertex*>(out);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			compact[i].Position = vertices[i].Position;
+			compact[i].Normal = packVertexNormal(vertices[i].Normal);
+			compact[i].texCoords[0] = glm::packHalf1x16(vertices[i].texCoords.x);
+			compact[i].texCoords[1] = glm::packHalf1x16(vertices[i].texCoords.y);
+		}
+	}
+	else
+	{
+		QuantizedVertex* quantized = static_cast<QuantizedVertex*>(out);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			glm::vec3 unit = (vertices[i].Position - offset) / scale;
+			for (int c = 0; c < 3; c++)
+				quantized[i].Position[c] = glm::packUnorm1x16(unit[c]);
+			quantized[i].Position[3] = 0;
+			quantized[i].Normal = packVertexNormal(vertices[i].Normal);
+			quantized[i].texCoords[0] = glm::packHalf1x16(vertices[i].texCoords.x);
+			quantized[i].texCoords[1] = glm::packHalf1x16(vertices[i].texCoords.y);
+		}
+	}
+}
+
+//write 'indices' to 'out' as 'indexType'
+void encodeIndices(const vector<unsigned int>& indices, GLenum indexType, void* out)
+{
+	if (indexType == GL_UNSIGNED_SHORT)
+	{
+		uint16_t* shorts = static_cast<uint16_t*>(out);
+		for (size_t i = 0; i < indices.size(); i++)
+			shorts[i] = static_cast<uint16_t>(indices[i]);
+	}
+	else if (!indices.empty())
+	{
+		memcpy(out, indices.data(), indices.size() * sizeof(unsigned int));
+	}
+}
+
+//convert 'vertices' & 'indices' to 'format' in memory (e.g. to cook them to disk)
+void encodeMeshBuffers(const vector<Vertex>& vertices, const vector<unsigned int>& indices, VertexFormat format, MeshBuffers& buffers)
+{
+	buffers.format = format;
+	positionQuantization(vertices, format, buffers.positionOffset, buffers.positionScale);
+	buffers.vertexData.resize(vertices.size() * vertexFormatSize(format));
+	encodeVertices(vertices, format, buffers.positionOffset, buffers.positionScale, buffers.vertexData.data());
+
+	buffers.indexType = chooseIndexType(format, vertices.size());
+	buffers.indexData.resize(indices.size() * (buffers.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int)));
+	encodeIndices(indices, buffers.indexType, buffers.indexData.data());
+}
+
 class Mesh
 {
 public:
@@ -42,109 +225,200 @@ public:
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
+	//levels of detail, finest first; all share the vertex buffer and index into their own part of 'indices'
+	vector<MeshLod> lods;
+	//VAO of the format's GeometryArena, shared with every other mesh of that format
 	unsigned int VAO;
+	//where the mesh starts in the arena: vertex for basevertex, and first index (in indexType units)
+	int baseVertex;
+	unsigned int baseIndex;
+
+	//GPU vertex layout, index type and position decoding (see MeshBuffers)
+	VertexFormat format;
+	GLenum indexType;
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
 
-	//constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	//constructor, takes over the data passed in (move it in to avoid copies)
+	//the geometry is encoded straight into the mapped GL buffers
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<MeshLod> lods = {},
+		VertexFormat format = VERTEX_FORMAT_FULL)
+		: vertices(move(vertices)), indices(move(indices)), textures(move(textures)), lods(move(lods))
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		if (this->lods.empty())
+			this->lods.push_back({ 0, static_cast<unsigned int>(this->indices.size()) });
 
 		//set the vertex buffers and its attribute pointers after getting all required data
-		setupMesh();
+		glm::vec3 offset, scale;
+		positionQuantization(this->vertices, format, offset, scale);
+		setBufferLayout(format, chooseIndexType(format, this->vertices.size()), offset, scale);
+		size_t vertexBytes = this->vertices.size() * vertexFormatSize(format);
+		size_t indexBytes = this->indices.size() * indexSize();
+		GeometryRange range = allocateRange(this->vertices.size(), indexBytes);
+		size_t vertexStart = geometryArena(format).vertexByteOffset(baseVertex);
+
+		GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+		void* mapped = vertexBytes ? glMapBufferRange(GL_ARRAY_BUFFER, vertexStart, vertexBytes, access) : NULL;
+		if (mapped)
+			encodeVertices(this->vertices, format, offset, scale, mapped);
+		if (!mapped || !glUnmapBuffer(GL_ARRAY_BUFFER))
+		{
+			//mapping failed or the store was lost while mapped, go through a temporary copy instead
+			vector<unsigned char> encoded(vertexBytes);
+			encodeVertices(this->vertices, format, offset, scale, encoded.data());
+			glBufferSubData(GL_ARRAY_BUFFER, vertexStart, vertexBytes, encoded.data());
+		}
+		mapped = indexBytes ? glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, range.indexByteOffset, indexBytes, access) : NULL;
+		if (mapped)
+			encodeIndices(this->indices, indexType, mapped);
+		if (!mapped || !glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER))
+		{
+			vector<unsigned char> encoded(indexBytes);
+			encodeIndices(this->indices, indexType, encoded.data());
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.indexByteOffset, indexBytes, encoded.data());
+		}
+		glBindVertexArray(0);
+	}
+
+	//constructor from geometry already encoded for the GPU (e.g. a mapped mesh cache), uploaded straight from 'gpuVertices' & 'gpuIndices'
+	//'vertexData' & 'indexData' are the same geometry as Vertex & unsigned int for CPU-side queries, null to keep no CPU copy
+	Mesh(const Vertex* vertexData, unsigned int vertexCount, const unsigned int* indexData, unsigned int indexCount,
+		vector<Texture> textures, vector<MeshLod> lods, const MeshBuffers& layout,
+		const void* gpuVertices, size_t gpuVertexBytes, const void* gpuIndices, size_t gpuIndexBytes)
+		: textures(move(textures)), lods(move(lods))
+	{
+		if (vertexData && indexData)
+		{
+			this->vertices.assign(vertexData, vertexData + vertexCount);
+			this->indices.assign(indexData, indexData + indexCount);
+		}
+		if (this->lods.empty())
+			this->lods.push_back({ 0, indexCount });
+
+		setBufferLayout(layout.format, layout.indexType, layout.positionOffset, layout.positionScale);
+		GeometryRange range = allocateRange(gpuVertexBytes / vertexFormatSize(format), gpuIndexBytes);
+		glBufferSubData(GL_ARRAY_BUFFER, geometryArena(format).vertexByteOffset(baseVertex), gpuVertexBytes, gpuVertices);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.indexByteOffset, gpuIndexBytes, gpuIndices);
+		glBindVertexArray(0);
+	}
+
+	//free the CPU copy of the geometry once it only lives on the GPU
+	//vertices & indices are empty afterwards, so CPU-side queries (Model::innerRadius, picking) no longer work
+	void releaseGeometry()
+	{
+		vector<Vertex>().swap(vertices);
+		vector<unsigned int>().swap(indices);
+	}
+
+	//bytes per index
+	unsigned int indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int); }
+
+	//first index of a level in the arena's index buffer, for indirect commands
+	unsigned int arenaFirstIndex(const MeshLod& lod) const { return baseIndex + lod.firstIndex; }
+
+	//element array offset of a level in the arena's index buffer, for glDrawElements*BaseVertex
+	void* indexOffset(const MeshLod& lod) const { return (void*)(static_cast<size_t>(arenaFirstIndex(lod)) * indexSize()); }
+
+	//set the 'positionOffset' & 'positionScale' uniforms the vertex shaders decode positions with
+	void setPositionDecode(Shader& shader) const
+	{
+		resolveUniforms(shader);
+		uniforms.positionOffset.set(positionOffset);
+		uniforms.positionScale.set(positionScale);
 	}
 
 	void Draw(Shader& shader)
 	{
 		//bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
-
+		resolveUniforms(shader);
 		for (unsigned int i = 0;i < textures.size();i++)
 		{
 			//active proper texture unit before binding
 			glActiveTexture(GL_TEXTURE0 + i);
-
-			//retrieve texture number(the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = to_string(specularNr++);
-			else if (name == "texture_normal")
-				number = to_string(normalNr++);
-			else if (name == "texture_height")
-				number = to_string(heightNr++);
-
 			//set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			//bind the texture
+			glUniform1i(uniforms.samplers[i], i);
+			//bind the texture, filtered by the shared material sampler
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			glBindSampler(i, materialSampler());
 		}
 
 		//draw mesh
+		setPositionDecode(shader);
 		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, lods[0].indexCount, indexType, indexOffset(lods[0]), baseVertex);
 		glBindVertexArray(0);
 
+		//other passes use these units with their textures' own filtering
+		for (unsigned int i = 0; i < textures.size(); i++)
+			glBindSampler(i, 0);
 		//set to default once configured
 		glActiveTexture(GL_TEXTURE0);
 	}
 
 private:
-	//render data
-	unsigned int VBO, EBO;
-
-	//initialise all the buffer objects/arrays
-	void setupMesh()
+	//uniform locations in the program they were last resolved for, so drawing builds and looks up no names
+	struct MeshUniforms
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
+		unsigned int program = 0;
+		UniformHandle<glm::vec3> positionOffset;
+		UniformHandle<glm::vec3> positionScale;
+		//per texture, -1 where the shader doesn't sample it
+		vector<GLint> samplers;
+	};
+	mutable MeshUniforms uniforms;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-		//vertex position
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-		//vertex normal
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-
-		//vertex texture coordinate
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
-
-		//vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-
-		//vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	void resolveUniforms(Shader& shader) const
+	{
+		if (uniforms.program == shader.ID)
+			return;
+		uniforms.program = shader.ID;
+		uniforms.positionOffset.location = shader.findUniform("positionOffset");
+		uniforms.positionScale.location = shader.findUniform("positionScale");
 
-		//ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+		//samplers are named type + N (diffuse_textureN), either plain or as members of the shader's 'material'
+		unsigned int diffuseNr = 1;
+		unsigned int specularNr = 1;
+		unsigned int normalNr = 1;
+		unsigned int heightNr = 1;
+		uniforms.samplers.clear();
+		for (const Texture& texture : textures)
+		{
+			//retrieve texture number(the N in diffuse_textureN)
+			string number;
+			string name = texture.type;
+			if (name == "texture_diffuse")
+				number = to_string(diffuseNr++);
+			else if (name == "texture_specular")
+				number = to_string(specularNr++);
+			else if (name == "texture_normal")
+				number = to_string(normalNr++);
+			else if (name == "texture_height")
+				number = to_string(heightNr++);
 
-		//weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+			GLint location = shader.findUniform(name + number);
+			if (location < 0)
+				location = shader.findUniform("material." + name + number);
+			uniforms.samplers.push_back(location);
+		}
+	}
 
-		glBindVertexArray(0);
+	void setBufferLayout(VertexFormat format, GLenum indexType, const glm::vec3& positionOffset, const glm::vec3& positionScale)
+	{
+		this->format = format;
+		this->indexType = indexType;
+		this->positionOffset = positionOffset;
+		this->positionScale = positionScale;
 	}
 
-	
+	//take a range of the format's arena, leaving its VAO & vertex buffer bound for the upload
+	GeometryRange allocateRange(size_t vertexCount, size_t indexBytes)
+	{
+		GeometryArena& arena = geometryArena(format);
+		GeometryRange range = arena.allocate(vertexCount, indexBytes);
+		VAO = arena.VAO;
+		baseVertex = range.baseVertex;
+		baseIndex = static_cast<unsigned int>(range.indexByteOffset / indexSize());
+		return range;
+	}
 };
 #endif
\ No newline at end of file
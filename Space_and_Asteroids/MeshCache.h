@@ -0,0 +1,298 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <Mesh.h>
+#include <MappedFile.h>
+#include <Hash.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//cooked model, written after the first Assimp import and memory mapped on later loads
+//layout (every section 16-byte aligned):
+//  header
+//  mesh table         meshCount x CookedMesh
+//  texture table      textureCount x CookedTexture, referencing the string blob
+//  per mesh           vertices (Vertex) & indices (unsigned int, all levels) for the CPU, MeshLod ranges,
+//                     vertex & index buffers encoded in the mesh's VertexFormat
+//  string blob        texture types & paths
+//the encoded buffers are in the GL layout and go from the mapping straight into glBufferData
+const char meshCacheMagic[4] = { 'M', 'E', 'S', 'H' };
+const uint32_t meshCacheVersion = 3;
+
+struct MeshCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexBytes;
+	uint32_t meshCount;
+	//hash of the source files and import settings, see meshSourceHash
+	uint64_t sourceHash;
+	uint32_t textureCount;
+	float boundingRadius;
+	uint64_t meshOffset;
+	uint64_t textureOffset;
+	uint64_t stringOffset;
+	uint64_t stringBytes;
+};
+
+struct CookedMesh
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t lodCount;
+	//range of the texture table used by this mesh
+	uint32_t firstTexture;
+	uint32_t textureCount;
+
+	//GPU buffers, see MeshBuffers
+	uint32_t format;
+	uint32_t indexType;
+	float positionOffset[3];
+	float positionScale[3];
+	uint64_t gpuVertexOffset;
+	uint64_t gpuVertexBytes;
+	uint64_t gpuIndexOffset;
+	uint64_t gpuIndexBytes;
+};
+
+struct CookedTexture
+{
+	uint32_t typeOffset;
+	uint32_t typeLength;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+};
+
+//hash of everything the cooked model depends on: the model file, its material library, the number of LOD levels
+//and the vertex format
+uint64_t meshSourceHash(const string& path, unsigned int lodLevels, VertexFormat format)
+{
+	uint64_t hash = hashBytes(&meshCacheVersion, sizeof(meshCacheVersion));
+	hash = hashBytes(&lodLevels, sizeof(lodLevels), hash);
+	hash = hashBytes(&format, sizeof(format), hash);
+	if (!hashFile(path, hash))
+		return 0;
+	//the .mtl next to an .obj names the textures
+	size_t dot = path.find_last_of('.');
+	if (dot != string::npos)
+		hashFile(path.substr(0, dot) + ".mtl", hash);
+	return hash;
+}
+
+//write 'meshes' to 'path'
+bool saveMeshCache(const string& path, uint64_t sourceHash, float boundingRadius, const vector<Mesh>& meshes)
+{
+	auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+	vector<CookedMesh> table(meshes.size());
+	vector<CookedTexture> textures;
+	string strings;
+	auto addString = [&](const string& text, uint32_t& offset, uint32_t& length)
+	{
+		offset = static_cast<uint32_t>(strings.size());
+		length = static_cast<uint32_t>(text.size());
+		strings += text;
+	};
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+	header.version = meshCacheVersion;
+	header.vertexBytes = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.sourceHash = sourceHash;
+	header.boundingRadius = boundingRadius;
+	for (const Mesh& mesh : meshes)
+	{
+		for (const Texture& texture : mesh.textures)
+		{
+			CookedTexture cooked;
+			addString(texture.type, cooked.typeOffset, cooked.typeLength);
+			addString(texture.path, cooked.pathOffset, cooked.pathLength);
+			textures.push_back(cooked);
+		}
+	}
+	header.textureCount = static_cast<uint32_t>(textures.size());
+	header.meshOffset = align(sizeof(header));
+	header.textureOffset = align(header.meshOffset + table.size() * sizeof(CookedMesh));
+
+	uint64_t offset = align(header.textureOffset + textures.size() * sizeof(CookedTexture));
+	uint32_t firstTexture = 0;
+	vector<MeshBuffers> buffers(meshes.size());
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		CookedMesh& cooked = table[i];
+		memset(&cooked, 0, sizeof(cooked));
+		encodeMeshBuffers(mesh.vertices, mesh.indices, mesh.format, buffers[i]);
+		cooked.format = buffers[i].format;
+		cooked.indexType = buffers[i].indexType;
+		for (int c = 0; c < 3; c++)
+		{
+			cooked.positionOffset[c] = buffers[i].positionOffset[c];
+			cooked.positionScale[c] = buffers[i].positionScale[c];
+		}
+		cooked.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		cooked.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		cooked.lodCount = static_cast<uint32_t>(mesh.lods.size());
+		cooked.firstTexture = firstTexture;
+		cooked.textureCount = static_cast<uint32_t>(mesh.textures.size());
+		firstTexture += cooked.textureCount;
+		cooked.vertexOffset = offset;
+		cooked.indexOffset = align(cooked.vertexOffset + uint64_t(cooked.vertexCount) * sizeof(Vertex));
+		cooked.lodOffset = align(cooked.indexOffset + uint64_t(cooked.indexCount) * sizeof(unsigned int));
+		cooked.gpuVertexOffset = align(cooked.lodOffset + cooked.lodCount * sizeof(MeshLod));
+		cooked.gpuVertexBytes = buffers[i].vertexData.size();
+		cooked.gpuIndexOffset = align(cooked.gpuVertexOffset + cooked.gpuVertexBytes);
+		cooked.gpuIndexBytes = buffers[i].indexData.size();
+		offset = align(cooked.gpuIndexOffset + cooked.gpuIndexBytes);
+	}
+	header.stringOffset = offset;
+	header.stringBytes = strings.size();
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+	{
+		cout << "ERROR::MESH_CACHE::FILE_NOT_WRITABLE: " << path << endl;
+		return false;
+	}
+	auto writeAt = [&](uint64_t offset, const void* data, size_t bytes)
+	{
+		static const char zeros[16] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		file.write(zeros, static_cast<streamsize>(offset - position));
+		file.write(static_cast<const char*>(data), static_cast<streamsize>(bytes));
+	};
+	writeAt(0, &header, sizeof(header));
+	writeAt(header.meshOffset, table.data(), table.size() * sizeof(CookedMesh));
+	writeAt(header.textureOffset, textures.data(), textures.size() * sizeof(CookedTexture));
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		writeAt(table[i].vertexOffset, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+		writeAt(table[i].indexOffset, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+		writeAt(table[i].lodOffset, meshes[i].lods.data(), meshes[i].lods.size() * sizeof(MeshLod));
+		writeAt(table[i].gpuVertexOffset, buffers[i].vertexData.data(), buffers[i].vertexData.size());
+		writeAt(table[i].gpuIndexOffset, buffers[i].indexData.data(), buffers[i].indexData.size());
+	}
+	writeAt(header.stringOffset, strings.data(), strings.size());
+
+	if (!file)
+	{
+		cout << "ERROR::MESH_CACHE::WRITE_FAILED: " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+//read access to a mapped cooked model
+class MeshCacheFile
+{
+public:
+	MeshCacheHeader header;
+
+	//map 'path', false if it is missing, damaged or cooked from other sources than 'sourceHash'
+	bool open(const string& path, uint64_t sourceHash)
+	{
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(header))
+			return fail(path);
+		memcpy(&header, file.data(), sizeof(header));
+		if (memcmp(header.magic, meshCacheMagic, sizeof(header.magic)) != 0 || header.version != meshCacheVersion
+			|| header.vertexBytes != sizeof(Vertex))
+			return fail(path);
+		if (header.sourceHash != sourceHash)
+		{
+			file.close();
+			return false;
+		}
+		if (header.meshOffset + uint64_t(header.meshCount) * sizeof(CookedMesh) > file.size()
+			|| header.textureOffset + uint64_t(header.textureCount) * sizeof(CookedTexture) > file.size()
+			|| header.stringOffset + header.stringBytes > file.size())
+			return fail(path);
+		for (unsigned int i = 0; i < header.meshCount; i++)
+		{
+			const CookedMesh& cooked = mesh(i);
+			if (cooked.vertexOffset + uint64_t(cooked.vertexCount) * sizeof(Vertex) > file.size()
+				|| cooked.indexOffset + uint64_t(cooked.indexCount) * sizeof(unsigned int) > file.size()
+				|| cooked.lodOffset + uint64_t(cooked.lodCount) * sizeof(MeshLod) > file.size()
+				|| cooked.gpuVertexOffset + cooked.gpuVertexBytes > file.size()
+				|| cooked.gpuIndexOffset + cooked.gpuIndexBytes > file.size()
+				|| cooked.format > VERTEX_FORMAT_QUANTIZED
+				|| cooked.firstTexture + uint64_t(cooked.textureCount) > header.textureCount)
+				return fail(path);
+
+			//what is handed to the GL draws: the encoded buffers must hold exactly their counts and every level stay
+			//inside the mesh's indices, or a draw reads past the mesh's range of the arena
+			if (cooked.indexType != GL_UNSIGNED_SHORT && cooked.indexType != GL_UNSIGNED_INT)
+				return fail(path);
+			uint64_t indexSize = cooked.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+			if (cooked.gpuIndexBytes != uint64_t(cooked.indexCount) * indexSize
+				|| cooked.gpuVertexBytes != uint64_t(cooked.vertexCount) * vertexFormatSize(static_cast<VertexFormat>(cooked.format)))
+				return fail(path);
+			const MeshLod* levels = lods(cooked);
+			for (unsigned int l = 0; l < cooked.lodCount; l++)
+			{
+				if (uint64_t(levels[l].firstIndex) + levels[l].indexCount > cooked.indexCount)
+					return fail(path);
+			}
+		}
+		return true;
+	}
+
+	const CookedMesh& mesh(unsigned int i) const
+	{
+		return reinterpret_cast<const CookedMesh*>(file.data() + header.meshOffset)[i];
+	}
+
+	const Vertex* vertices(const CookedMesh& mesh) const { return reinterpret_cast<const Vertex*>(file.data() + mesh.vertexOffset); }
+	const unsigned int* indices(const CookedMesh& mesh) const { return reinterpret_cast<const unsigned int*>(file.data() + mesh.indexOffset); }
+	const MeshLod* lods(const CookedMesh& mesh) const { return reinterpret_cast<const MeshLod*>(file.data() + mesh.lodOffset); }
+	const void* gpuVertices(const CookedMesh& mesh) const { return file.data() + mesh.gpuVertexOffset; }
+	const void* gpuIndices(const CookedMesh& mesh) const { return file.data() + mesh.gpuIndexOffset; }
+
+	//format, index type & position decoding of a mesh's encoded buffers (the data vectors stay empty)
+	MeshBuffers layout(const CookedMesh& mesh) const
+	{
+		MeshBuffers layout;
+		layout.format = static_cast<VertexFormat>(mesh.format);
+		layout.indexType = mesh.indexType;
+		layout.positionOffset = glm::vec3(mesh.positionOffset[0], mesh.positionOffset[1], mesh.positionOffset[2]);
+		layout.positionScale = glm::vec3(mesh.positionScale[0], mesh.positionScale[1], mesh.positionScale[2]);
+		return layout;
+	}
+
+	const CookedTexture& texture(unsigned int i) const
+	{
+		return reinterpret_cast<const CookedTexture*>(file.data() + header.textureOffset)[i];
+	}
+
+	string text(uint32_t offset, uint32_t length) const
+	{
+		if (uint64_t(offset) + length > header.stringBytes)
+			return string();
+		return string(reinterpret_cast<const char*>(file.data() + header.stringOffset + offset), length);
+	}
+
+private:
+	MappedFile file;
+
+	bool fail(const string& path)
+	{
+		cout << "ERROR::MESH_CACHE::INVALID_FILE: " << path << endl;
+		file.close();
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <Mesh.h>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+using namespace std;
+
+//entries of the post-transform vertex cache assumed when ordering triangles
+const unsigned int vertexCacheSize = 16;
+
+//cost of a triangle list under a FIFO post-transform cache of 'cacheSize' entries
+struct VertexCacheStats
+{
+	//average cache miss ratio: vertex shader runs per triangle (0.5 is ideal, 3 is no reuse at all)
+	float acmr;
+	//average transform to vertex ratio: vertex shader runs per referenced vertex (1 is ideal)
+	float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = vertexCacheSize)
+{
+	vector<unsigned int> cachedAt(vertexCount, 0);
+	vector<bool> used(vertexCount, false);
+	unsigned int misses = 0, referenced = 0;
+	for (unsigned int index : indices)
+	{
+		//a vertex is still cached while fewer than 'cacheSize' misses happened since it was loaded
+		if (cachedAt[index] == 0 || misses - cachedAt[index] >= cacheSize)
+		{
+			misses++;
+			cachedAt[index] = misses;
+		}
+		if (!used[index])
+		{
+			used[index] = true;
+			referenced++;
+		}
+	}
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0f : float(misses) / float(indices.size() / 3);
+	stats.atvr = referenced == 0 ? 0.0f : float(misses) / float(referenced);
+	return stats;
+}
+
+//reorder the triangles of 'indices' for the post-transform cache (Tipsify, Sander et al. 2007), then sort the clusters it
+//produces so that outward-facing ones come first and hide what is drawn after them (less overdraw)
+//the triangles and their winding are unchanged, only their order
+void optimizeTriangleOrder(const vector<Vertex>& vertices, vector<unsigned int>& indices, unsigned int cacheSize = vertexCacheSize)
+{
+	size_t vertexCount = vertices.size();
+	unsigned int triangleCount = static_cast<unsigned int>(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	//vertex -> triangle adjacency, as offsets into one array
+	vector<unsigned int> live(vertexCount, 0);
+	for (unsigned int index : indices)
+		live[index]++;
+	vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+	vector<unsigned int> adjacency(indices.size());
+	vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+			adjacency[fill[indices[t * 3 + c]]++] = t;
+	}
+
+	vector<unsigned int> cacheTime(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<unsigned int> deadEnd;
+	vector<unsigned int> candidates;
+	vector<unsigned int> order;
+	order.reserve(triangleCount);
+	//a new cluster starts wherever the fan had to jump (the cache is effectively flushed there)
+	vector<unsigned int> clusterStart;
+	unsigned int timestamp = cacheSize + 1;
+	size_t cursor = 0;
+	int fan = indices[0];
+	bool jumped = true;
+
+	while (fan >= 0)
+	{
+		if (jumped)
+			clusterStart.push_back(static_cast<unsigned int>(order.size()));
+
+		//emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			order.push_back(t);
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+		}
+
+		//next fan: the candidate that will still be cached after its remaining triangles are emitted, oldest first
+		int best = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = timestamp - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		jumped = best < 0;
+		if (best < 0)
+		{
+			//dead end: a recently used vertex with triangles left, or else the next one in input order
+			while (!deadEnd.empty() && best < 0)
+			{
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					best = v;
+			}
+			while (best < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					best = static_cast<int>(cursor);
+				cursor++;
+			}
+		}
+		fan = best;
+	}
+	clusterStart.push_back(triangleCount);
+
+	//overdraw: clusters facing away from the mesh centre occlude the others, so draw them first
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	vector<glm::vec3> triangleNormal(triangleCount);
+	vector<glm::vec3> triangleCentre(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 p0 = vertices[indices[t * 3]].Position;
+		glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+		glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+		//length is twice the area, good enough as a weight
+		triangleNormal[t] = glm::cross(p1 - p0, p2 - p0);
+		triangleCentre[t] = (p0 + p1 + p2) / 3.0f;
+		float area = glm::length(triangleNormal[t]);
+		meshCentre += triangleCentre[t] * area;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f)
+		meshCentre /= meshArea;
+
+	struct Cluster
+	{
+		unsigned int first, last;
+		float occlusion;
+	};
+	vector<Cluster> clusters;
+	for (size_t c = 0; c + 1 < clusterStart.size(); c++)
+	{
+		if (clusterStart[c] == clusterStart[c + 1])
+			continue;
+		glm::vec3 centre(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (unsigned int i = clusterStart[c]; i < clusterStart[c + 1]; i++)
+		{
+			unsigned int t = order[i];
+			float weight = glm::length(triangleNormal[t]);
+			centre += triangleCentre[t] * weight;
+			normal += triangleNormal[t];
+			area += weight;
+		}
+		if (area > 0.0f)
+			centre /= area;
+		float length = glm::length(normal);
+		float occlusion = length > 0.0f ? glm::dot(centre - meshCentre, normal / length) : 0.0f;
+		clusters.push_back({ clusterStart[c], clusterStart[c + 1], occlusion });
+	}
+	stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.occlusion > b.occlusion; });
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (const Cluster& cluster : clusters)
+	{
+		for (unsigned int i = cluster.first; i < cluster.last; i++)
+			result.insert(result.end(), indices.begin() + order[i] * 3, indices.begin() + order[i] * 3 + 3);
+	}
+	indices.swap(result);
+}
+
+//renumber the vertices in the order the triangles first use them, so vertex fetch walks the buffer forwards
+//unreferenced vertices are dropped
+void optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	vector<unsigned int> remap(vertices.size(), UINT_MAX);
+	vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == UINT_MAX)
+		{
+			remap[index] = static_cast<unsigned int>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
+
+#endif
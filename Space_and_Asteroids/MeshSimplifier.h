@@ -0,0 +1,289 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <Mesh.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+//error quadric of a set of planes (Garland & Heckbert), stored as the upper triangle of a symmetric 4x4 matrix
+struct Quadric
+{
+	//xx, xy, xz, xw, yy, yz, yw, zz, zw, ww
+	double m[10];
+
+	Quadric() { memset(m, 0, sizeof(m)); }
+
+	void addPlane(double a, double b, double c, double d, double weight)
+	{
+		m[0] += weight * a * a; m[1] += weight * a * b; m[2] += weight * a * c; m[3] += weight * a * d;
+		m[4] += weight * b * b; m[5] += weight * b * c; m[6] += weight * b * d;
+		m[7] += weight * c * c; m[8] += weight * c * d;
+		m[9] += weight * d * d;
+	}
+
+	void add(const Quadric& other)
+	{
+		for (int i = 0; i < 10; i++)
+			m[i] += other.m[i];
+	}
+
+	//sum of squared distances from p to the planes
+	double evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x
+			+ m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y
+			+ m[7] * z * z + 2.0 * m[8] * z
+			+ m[9];
+	}
+};
+
+//simplify a triangle list by quadric-error edge collapses until it has at most 'targetIndexCount' indices
+//collapses move a vertex onto one of its neighbours (half-edge collapse), so the result indexes the same vertex array
+//and every LOD can share one vertex buffer
+//vertices on UV seams may only slide along the seam, vertices on open borders are locked
+vector<unsigned int> simplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount)
+{
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	//weld vertices sharing a position, topology is built on these canonical vertices
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+	};
+	unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> positionMap;
+	vector<unsigned int> canonical(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		canonical[v] = positionMap.emplace(vertices[v].Position, v).first->second;
+
+	//edges used by a single triangle are open borders, their ends are locked to keep the silhouette
+	vector<bool> locked(vertexCount, false);
+	unordered_map<uint64_t, unsigned int> edgeUse;
+	auto edgeKey = [](unsigned int a, unsigned int b)
+	{
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	};
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int e = 0; e < 3; e++)
+			edgeUse[edgeKey(canonical[indices[t * 3 + e]], canonical[indices[t * 3 + (e + 1) % 3]])]++;
+	}
+	for (const auto& edge : edgeUse)
+	{
+		if (edge.second == 1)
+		{
+			locked[edge.first >> 32] = true;
+			locked[edge.first & 0xffffffffu] = true;
+		}
+	}
+
+	//plane quadrics, weighted by triangle area, and vertex -> triangle adjacency
+	vector<unsigned int> corners(indices.begin(), indices.begin() + triangleCount * 3);
+	vector<Quadric> quadrics(vertexCount);
+	vector<vector<unsigned int>> vertexTriangles(vertexCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 p0 = vertices[corners[t * 3 + 0]].Position;
+		glm::vec3 p1 = vertices[corners[t * 3 + 1]].Position;
+		glm::vec3 p2 = vertices[corners[t * 3 + 2]].Position;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(n);
+		if (area > 0.0f)
+		{
+			n /= area;
+			Quadric q;
+			q.addPlane(n.x, n.y, n.z, -glm::dot(n, p0), area * 0.5f);
+			for (int c = 0; c < 3; c++)
+				quadrics[canonical[corners[t * 3 + c]]].add(q);
+		}
+		for (int c = 0; c < 3; c++)
+			vertexTriangles[canonical[corners[t * 3 + c]]].push_back(t);
+	}
+
+	//candidate collapses, cheapest first
+	//an entry is stale once either end has changed since it was pushed (tracked with per-vertex stamps)
+	struct Collapse
+	{
+		double cost;
+		unsigned int from, to;
+		unsigned int fromStamp, toStamp;
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+	priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+	vector<unsigned int> stamp(vertexCount, 0);
+	vector<bool> removed(vertexCount, false);
+	vector<bool> triangleRemoved(triangleCount, false);
+
+	auto pushCollapse = [&](unsigned int from, unsigned int to)
+	{
+		if (locked[from] || from == to)
+			return;
+		Quadric q = quadrics[from];
+		q.add(quadrics[to]);
+		heap.push({ q.evaluate(vertices[to].Position), from, to, stamp[from], stamp[to] });
+	};
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = canonical[corners[t * 3 + e]];
+			unsigned int b = canonical[corners[t * 3 + (e + 1) % 3]];
+			pushCollapse(a, b);
+			pushCollapse(b, a);
+		}
+	}
+
+	size_t liveTriangles = triangleCount;
+	size_t targetTriangles = targetIndexCount / 3;
+	while (liveTriangles > targetTriangles && !heap.empty())
+	{
+		Collapse collapse = heap.top();
+		heap.pop();
+		unsigned int from = collapse.from;
+		unsigned int to = collapse.to;
+		if (removed[from] || removed[to] || stamp[from] != collapse.fromStamp || stamp[to] != collapse.toStamp)
+			continue;
+
+		//each wedge (attribute set) of 'from' moves onto the wedge of 'to' it shares an edge with
+		//seam vertices can thus slide along their seam, but not across it: a wedge without a partner makes the collapse invalid
+		unsigned int wedgeFrom[4], wedgeTo[4];
+		unsigned int wedgePairs = 0;
+		for (unsigned int t : vertexTriangles[from])
+		{
+			if (triangleRemoved[t])
+				continue;
+			unsigned int fromVertex = UINT_MAX, toVertex = UINT_MAX;
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int vertex = corners[t * 3 + c];
+				if (canonical[vertex] == from)
+					fromVertex = vertex;
+				else if (canonical[vertex] == to)
+					toVertex = vertex;
+			}
+			if (toVertex == UINT_MAX)
+				continue;
+			bool known = false;
+			for (unsigned int w = 0; w < wedgePairs; w++)
+				known = known || wedgeFrom[w] == fromVertex;
+			if (!known && wedgePairs < 4)
+			{
+				wedgeFrom[wedgePairs] = fromVertex;
+				wedgeTo[wedgePairs] = toVertex;
+				wedgePairs++;
+			}
+		}
+		auto findWedge = [&](unsigned int vertex)
+		{
+			for (unsigned int w = 0; w < wedgePairs; w++)
+			{
+				if (wedgeFrom[w] == vertex)
+					return wedgeTo[w];
+			}
+			return UINT_MAX;
+		};
+
+		bool valid = wedgePairs > 0;
+		glm::vec3 target = vertices[to].Position;
+		for (unsigned int t : vertexTriangles[from])
+		{
+			if (!valid)
+				break;
+			if (triangleRemoved[t])
+				continue;
+
+			bool hasTo = false;
+			glm::vec3 before[3], after[3];
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int vertex = corners[t * 3 + c];
+				hasTo = hasTo || canonical[vertex] == to;
+				if (canonical[vertex] == from && findWedge(vertex) == UINT_MAX)
+					valid = false;
+				before[c] = vertices[vertex].Position;
+				after[c] = canonical[vertex] == from ? target : before[c];
+			}
+			if (hasTo || !valid)
+				continue;
+
+			//reject collapses that would fold a triangle over or squash it flat
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) <= 0.0f || glm::length(normalAfter) <= 1e-4f * glm::length(normalBefore))
+				valid = false;
+		}
+		if (!valid)
+			continue;
+
+		for (unsigned int t : vertexTriangles[from])
+		{
+			if (triangleRemoved[t])
+				continue;
+			bool hasTo = false;
+			for (int c = 0; c < 3; c++)
+				hasTo = hasTo || canonical[corners[t * 3 + c]] == to;
+			if (hasTo)
+			{
+				//triangles on the collapsed edge vanish
+				triangleRemoved[t] = true;
+				liveTriangles--;
+				continue;
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				if (canonical[corners[t * 3 + c]] == from)
+					corners[t * 3 + c] = findWedge(corners[t * 3 + c]);
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		removed[from] = true;
+		quadrics[to].add(quadrics[from]);
+		stamp[to]++;
+
+		//costs of every edge around 'to' changed with its quadric
+		for (unsigned int t : vertexTriangles[to])
+		{
+			if (triangleRemoved[t])
+				continue;
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int neighbour = canonical[corners[t * 3 + c]];
+				if (neighbour != to)
+				{
+					pushCollapse(to, neighbour);
+					pushCollapse(neighbour, to);
+				}
+			}
+		}
+	}
+
+	vector<unsigned int> result;
+	result.reserve(liveTriangles * 3);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		if (!triangleRemoved[t])
+			result.insert(result.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+	}
+	return result;
+}
+
+#endif
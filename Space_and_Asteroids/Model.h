@@ -11,6 +11,11 @@
 #include <stb_image.h>
 #include <Shader.h>
 #include <Mesh.h>
+#include <MeshSimplifier.h>
+#include <MeshOptimizer.h>
+#include <MeshCache.h>
+#include <TextureLoader.h>
+#include <TextureRegistry.h>
 
 #include <string>
 #include <fstream>
@@ -28,44 +33,131 @@ class Model
 public:
 	//model data
 	
-	//store all the textures loaded so far
-	//optimise to make sure textures aren't loaded more than once
+	//every distinct texture of the model, each holding a reference in the texture registry
+	//(which makes sure textures aren't loaded more than once, across all models)
 	vector<Texture> textures_loaded;
 	vector<Mesh> meshes;
 	string directory;
 	bool gammaCorrection;
+	//radius of the sphere around the model origin enclosing every vertex
+	float boundingRadius;
+	//maximum number of levels of detail built per mesh (1 = full mesh only)
+	unsigned int lodLevels;
+	//GPU vertex layout of every mesh
+	VertexFormat vertexFormat;
+	//whether the meshes keep their vertices & indices in memory after the upload (needed by innerRadius)
+	bool keepGeometry;
+	//decodes the textures in the background when set, they hold a placeholder until it uploads them
+	TextureLoader* textureLoader;
 
 	//constructor
-	Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+	Model(string const& path, bool gamma = false, unsigned int lodLevels = 1, VertexFormat vertexFormat = VERTEX_FORMAT_FULL,
+		bool keepGeometry = true, TextureLoader* textureLoader = nullptr)
+		: gammaCorrection(gamma), boundingRadius(0.0f), lodLevels(lodLevels), vertexFormat(vertexFormat), keepGeometry(keepGeometry),
+		textureLoader(textureLoader)
 	{
 		loadModel(path);
 	}
 
+	//give the textures back to the registry, which deletes those no other model uses
+	void releaseTextures()
+	{
+		for (const Texture& texture : textures_loaded)
+			textureRegistry().release(texture.id);
+		textures_loaded.clear();
+	}
+
 	//draw the model and thus all its meshes
-	void Draw(Shader shader)
+	void Draw(Shader& shader)
 	{
 		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shader);
 	}
 
+	//radius of the largest sphere around the model origin that stays inside every triangle's plane
+	//only meaningful for convex models enclosing the origin (e.g. the planet), where it bounds the solid from inside
+	//needs the CPU geometry, models loaded without keepGeometry return boundingRadius
+	float innerRadius() const
+	{
+		float radius = boundingRadius;
+		for (const Mesh& mesh : meshes)
+		{
+			if (mesh.indices.empty())
+				continue;
+			for (unsigned int i = 0; i + 2 < mesh.lods[0].indexCount; i += 3)
+			{
+				glm::vec3 p0 = mesh.vertices[mesh.indices[i]].Position;
+				glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].Position;
+				glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].Position;
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float length = glm::length(normal);
+				if (length > 0.0f)
+					radius = glm::min(radius, fabs(glm::dot(normal / length, p0)));
+			}
+		}
+		return radius;
+	}
+
 private:
 	//load a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector
+	//the result is cooked into 'path'.mesh, later loads map that instead of running ASSIMP until the sources change
 	void loadModel(string path)
 	{
+		//retrieve the directory path of the filepath
+		directory = path.substr(0, path.find_last_of("/"));
+
+		string cachePath = path + ".mesh";
+		uint64_t sourceHash = meshSourceHash(path, lodLevels, vertexFormat);
+		if (sourceHash != 0 && loadCachedModel(cachePath, sourceHash))
+			return;
+
 		//read file via ASSIMP
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
 			return;
 		}
-		//retrieve the directory path of the filepath
-		directory = path.substr(0, path.find_last_of("/"));
 
 		//process ASSIMP's root node recursively
 		processNode(scene->mRootNode, scene);
+
+		//the cache is cooked from the CPU geometry, so it is written before that is dropped
+		if (sourceHash != 0)
+			saveMeshCache(cachePath, sourceHash, boundingRadius, meshes);
+		if (!keepGeometry)
+		{
+			for (Mesh& mesh : meshes)
+				mesh.releaseGeometry();
+		}
+	}
+
+	bool loadCachedModel(const string& cachePath, uint64_t sourceHash)
+	{
+		MeshCacheFile cache;
+		if (!cache.open(cachePath, sourceHash))
+			return false;
+
+		boundingRadius = cache.header.boundingRadius;
+		for (unsigned int i = 0; i < cache.header.meshCount; i++)
+		{
+			const CookedMesh& cooked = cache.mesh(i);
+			vector<Texture> textures;
+			for (unsigned int t = cooked.firstTexture; t < cooked.firstTexture + cooked.textureCount; t++)
+			{
+				const CookedTexture& texture = cache.texture(t);
+				textures.push_back(loadTexture(cache.text(texture.pathOffset, texture.pathLength),
+					cache.text(texture.typeOffset, texture.typeLength)));
+			}
+			vector<MeshLod> lods(cache.lods(cooked), cache.lods(cooked) + cooked.lodCount);
+			//without keepGeometry only the encoded buffers are read from the mapping
+			meshes.emplace_back(keepGeometry ? cache.vertices(cooked) : NULL, cooked.vertexCount,
+				keepGeometry ? cache.indices(cooked) : NULL, cooked.indexCount, move(textures), move(lods),
+				cache.layout(cooked), cache.gpuVertices(cooked), cooked.gpuVertexBytes, cache.gpuIndices(cooked), cooked.gpuIndexBytes);
+		}
+		return true;
 	}
 
 	//process a node recursively
@@ -93,6 +185,8 @@ private:
 		vector<Vertex> vertices;
 		vector<unsigned int> indices;
 		vector<Texture> textures;
+		vertices.reserve(mesh->mNumVertices);
+		indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
 
 		//process each mesh vertices
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -105,6 +199,7 @@ private:
 			vector.y = mesh->mVertices[i].y;
 			vector.z = mesh->mVertices[i].z;
 			vertex.Position = vector;
+			boundingRadius = glm::max(boundingRadius, glm::length(vector));
 
 			//process normal
 			if (mesh->HasNormals())
@@ -179,8 +274,34 @@ private:
 			textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 		}
 
-		//return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
+		//order the triangles for the post-transform cache and overdraw, then the vertices for fetch locality
+		VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+		optimizeTriangleOrder(vertices, indices);
+		optimizeVertexFetch(vertices, indices);
+		VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+		cout << "Mesh " << mesh->mName.C_Str() << ": ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+
+		//build the simplified levels of detail, each with about half the triangles of the previous one
+		//they are appended to the index list and all draw from the same vertices
+		vector<MeshLod> lods;
+		lods.push_back({ 0, static_cast<unsigned int>(indices.size()) });
+		vector<unsigned int> lodIndices(indices);
+		for (unsigned int level = 1; level < lodLevels; level++)
+		{
+			vector<unsigned int> simplified = simplifyMesh(vertices, lodIndices, lodIndices.size() / 6 * 3);
+			//stop once the mesh can't be reduced any further
+			if (simplified.empty() || simplified.size() * 10 > lodIndices.size() * 9)
+				break;
+			vector<unsigned int> ordered(simplified);
+			optimizeTriangleOrder(vertices, ordered);
+			lods.push_back({ static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(ordered.size()) });
+			indices.insert(indices.end(), ordered.begin(), ordered.end());
+			lodIndices.swap(simplified);
+		}
+
+		//return a mesh object created from the extracted mesh data, handing the buffers over instead of copying them
+		return Mesh(move(vertices), move(indices), move(textures), move(lods), vertexFormat);
 	}
 
 	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
@@ -190,36 +311,38 @@ private:
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
-			bool skip = false;
+			textures.push_back(loadTexture(str.C_Str(), typeName));
+		}
 
-			for (unsigned int j = 0;j < textures_loaded.size(); j++)
-			{
-				if (strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true;
-					break;
-				}
-			}
-			if (!skip)
+		return textures;
+	}
+
+	//texture at 'path' (relative to the model), shared through the texture registry with every model using the same image
+	//the model holds one reference per distinct texture, in textures_loaded
+	Texture loadTexture(const string& path, const string& typeName)
+	{
+		Texture texture;
+		texture.id = textureRegistry().acquire(this->directory + '/' + path, textureLoader);
+		texture.type = typeName;
+		texture.path = path;
+		for (const Texture& loaded : textures_loaded)
+		{
+			if (loaded.id == texture.id)
 			{
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);
+				textureRegistry().release(texture.id);
+				return texture;
 			}
 		}
-
-		return textures;
+		textures_loaded.push_back(texture);
+		return texture;
 	}
 };
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
 	string fileName = string(path);
-	fileName = directory + '/' + fileName;
+	if (!directory.empty())
+		fileName = directory + '/' + fileName;
 
 	unsigned int textureID;
 	int width, height, nrChannels;
@@ -242,7 +365,8 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		//sample the mipmaps generated above (GL_LINEAR would only ever read the base level)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 		stbi_image_free(data);
@@ -0,0 +1,140 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <MappedFile.h>
+#include <Hash.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//linked program binaries saved after the first build and loaded with glProgramBinary on later launches
+//a file holds one program, keyed on its sources, link inputs and the driver: any change (even a driver update)
+//makes the key differ and the program is built from source again and the file rewritten
+//layout: header, then 'binaryBytes' of driver binary
+const char programCacheMagic[4] = { 'P', 'R', 'O', 'G' };
+const uint32_t programCacheVersion = 1;
+
+struct ProgramCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binaryBytes;
+};
+
+//glGetProgramBinary & glProgramBinary are core from GL 4.1, and drivers may still offer no binary format at all
+bool programBinariesSupported()
+{
+	if (!GLAD_GL_VERSION_4_1)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+//file of the program built from the stages at 'stagePaths', in a cache directory next to the first one
+string programCachePath(const vector<string>& stagePaths)
+{
+	filesystem::path first(stagePaths.front());
+	string name;
+	for (const string& stage : stagePaths)
+		name += (name.empty() ? "" : "+") + filesystem::path(stage).filename().string();
+	return (first.parent_path() / "cache" / (name + ".program")).string();
+}
+
+//key of a program: every stage's source, the transform feedback varyings and the vendor, renderer & version strings
+uint64_t programCacheKey(const vector<string>& sources, const vector<string>& feedbackVaryings)
+{
+	uint64_t key = hashBytes(&programCacheVersion, sizeof(programCacheVersion));
+	for (const string& source : sources)
+	{
+		//the length separates the stages, so moving text from one to the next changes the key
+		uint64_t length = source.size();
+		key = hashBytes(&length, sizeof(length), key);
+		key = hashString(source, key);
+	}
+	for (const string& varying : feedbackVaryings)
+		key = hashString(varying + '\n', key);
+	GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum name : driverStrings)
+	{
+		const GLubyte* text = glGetString(name);
+		if (text)
+			key = hashString(reinterpret_cast<const char*>(text), key);
+	}
+	return key;
+}
+
+//hand the binary at 'path' to 'program', false if there is none for 'key'
+//the driver may still reject it (check GL_LINK_STATUS, which waits for it), the program is then built from source
+bool loadProgramBinary(const string& path, uint64_t key, unsigned int program)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	ProgramCacheHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, programCacheMagic, sizeof(header.magic)) != 0 || header.version != programCacheVersion
+		|| sizeof(header) + uint64_t(header.binaryBytes) > file.size())
+	{
+		cout << "ERROR::PROGRAM_CACHE::INVALID_FILE: " << path << endl;
+		return false;
+	}
+	if (header.key != key)
+		return false;
+
+	glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), header.binaryBytes);
+	return true;
+}
+
+//save the binary of the linked 'program' to 'path' (the program must have been linked with
+//GL_PROGRAM_BINARY_RETRIEVABLE_HINT set)
+bool saveProgramBinary(const string& path, uint64_t key, unsigned int program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, programCacheMagic, sizeof(header.magic));
+	header.version = programCacheVersion;
+	header.key = key;
+	header.binaryFormat = format;
+	header.binaryBytes = static_cast<uint32_t>(length);
+
+	error_code error;
+	filesystem::create_directories(filesystem::path(path).parent_path(), error);
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+	{
+		cout << "ERROR::PROGRAM_CACHE::FILE_NOT_WRITABLE: " << path << endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), length);
+	if (!file)
+	{
+		cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED: " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+#endif
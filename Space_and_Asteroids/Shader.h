@@ -4,99 +4,137 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <ProgramCache.h>
+
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 using namespace std;
 
+//uniform upload by value type, 'count' elements of an array starting at 'location'
+inline void setUniform(GLint location, const int* value, GLsizei count = 1) { glUniform1iv(location, count, value); }
+inline void setUniform(GLint location, const float* value, GLsizei count = 1) { glUniform1fv(location, count, value); }
+inline void setUniform(GLint location, const glm::vec2* value, GLsizei count = 1) { glUniform2fv(location, count, &(*value)[0]); }
+inline void setUniform(GLint location, const glm::vec3* value, GLsizei count = 1) { glUniform3fv(location, count, &(*value)[0]); }
+inline void setUniform(GLint location, const glm::vec4* value, GLsizei count = 1) { glUniform4fv(location, count, &(*value)[0]); }
+inline void setUniform(GLint location, const glm::mat2* value, GLsizei count = 1) { glUniformMatrix2fv(location, count, GL_FALSE, &(*value)[0][0]); }
+inline void setUniform(GLint location, const glm::mat3* value, GLsizei count = 1) { glUniformMatrix3fv(location, count, GL_FALSE, &(*value)[0][0]); }
+inline void setUniform(GLint location, const glm::mat4* value, GLsizei count = 1) { glUniformMatrix4fv(location, count, GL_FALSE, &(*value)[0][0]); }
+
+//whether a uniform of GL type 'type' can be set with a T
+template <typename T> bool uniformTypeMatches(GLenum type);
+template <> inline bool uniformTypeMatches<int>(GLenum type)
+{
+	return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_ARRAY;
+}
+template <> inline bool uniformTypeMatches<float>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool uniformTypeMatches<glm::vec2>(GLenum type) { return type == GL_FLOAT_VEC2; }
+template <> inline bool uniformTypeMatches<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+template <> inline bool uniformTypeMatches<glm::vec4>(GLenum type) { return type == GL_FLOAT_VEC4; }
+template <> inline bool uniformTypeMatches<glm::mat2>(GLenum type) { return type == GL_FLOAT_MAT2; }
+template <> inline bool uniformTypeMatches<glm::mat3>(GLenum type) { return type == GL_FLOAT_MAT3; }
+template <> inline bool uniformTypeMatches<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+
+//location of a uniform resolved once (see Shader::uniform), setting it is a single glUniform* call on the program in use
+//a handle to a missing uniform has location -1, which GL ignores
+template <typename T>
+struct UniformHandle
+{
+	GLint location = -1;
+
+	void set(const T& value) const { setUniform(location, &value); }
+	void set(const T* values, GLsizei count) const { setUniform(location, values, count); }
+	bool valid() const { return location >= 0; }
+};
+
+//uniform blocks shared by all programs (see UniformBuffer.h), each on a fixed binding point
+//programs declaring them are bound at link time, so one glBindBufferRange per frame reaches every program
+enum UniformBlockBinding
+{
+	FRAME_DATA_BINDING,
+	LIGHT_DATA_BINDING,
+	UNIFORM_BLOCK_BINDINGS
+};
+const char* const uniformBlockNames[UNIFORM_BLOCK_BINDINGS] = { "FrameData", "LightData" };
+
+//an active uniform of a linked program, as reported by glGetActiveUniform
+struct UniformInfo
+{
+	GLint location;
+	GLenum type;
+	//array length, 1 for plain uniforms
+	GLint size;
+	//whether anything ever resolved or set it, see Shader::checkUniforms
+	mutable bool used;
+};
+
+class ShaderBatch;
+
 class Shader
 {
 public:
 	//program id
 	unsigned int ID;
+	//active uniforms outside of blocks by name (arrays without their "[0]"), filled after linking
+	unordered_map<string, UniformInfo> uniforms;
+	//active uniform blocks by name, to their block index
+	unordered_map<string, GLuint> uniformBlocks;
 
 	//constructor & build shaders
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	//fragmentPath may be null for transform feedback programs, which capture 'feedbackVaryings' (interleaved) instead
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const vector<string>& feedbackVaryings = {})
 	{
-		//1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		//ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		submit(vertexPath, fragmentPath, geometryPath, feedbackVaryings);
+		resolve();
+	}
+
+	//constructor that only starts the build, the program is usable once 'batch' is finished (see ShaderBatch)
+	//the batch keeps a pointer to the shader, so it must stay where it is until then
+	Shader(ShaderBatch& batch, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+		const vector<string>& feedbackVaryings = {});
+
+	//complete a submitted build: check the compile & link status (waiting for the driver if it isn't done yet),
+	//save the binary and reflect the uniforms
+	void resolve()
+	{
+		if (!build.pending)
+			return;
+		build.pending = false;
+
+		bool linked;
+		if (build.fromCache)
 		{
-			//open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			//read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			//close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			//convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			//if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
+			GLint success = 0;
+			glGetProgramiv(ID, GL_LINK_STATUS, &success);
+			linked = success != 0;
+			if (!linked)
 			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
+				//the driver rejected the cached binary, build from source
+				build.fromCache = false;
+				compile();
+				linked = checkBuild();
 			}
 		}
-		catch (std::ifstream::failure& e)
+		else
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+			linked = checkBuild();
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		//2. compile shaders
-		unsigned int vertex, fragment;
-		//vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		//fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		//if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
+		if (linked && !build.fromCache && build.binaries)
+			saveProgramBinary(build.cachePath, build.cacheKey, ID);
+		reflectUniforms();
+
+		//delete the shaders as they're linked into our program now and no longer necessary
+		for (unsigned int stage : build.stages)
 		{
-			const char* gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+			glDetachShader(ID, stage);
+			glDeleteShader(stage);
 		}
-		//shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		//delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
+		build = PendingBuild();
 	}
 
 	void use() const
@@ -104,76 +142,315 @@ public:
 		glUseProgram(ID);
 	}
 
-	// utility uniform functions
+	//issue a draw that produces no fragments, so the driver finishes any deferred compilation of the program
+	//for the render state of an empty VAO now rather than in the first frame that uses it
+	//'emptyVAO' has no attributes enabled; points suit every program here (the cull pass's geometry shader takes points)
+	void warmUp(unsigned int emptyVAO) const
+	{
+		GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+		GLint box[4];
+		glGetIntegerv(GL_SCISSOR_BOX, box);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, 0, 0, 0);
+
+		use();
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_POINTS, 0, 1);
+		glBindVertexArray(0);
+
+		glScissor(box[0], box[1], box[2], box[3]);
+		if (!scissor)
+			glDisable(GL_SCISSOR_TEST);
+	}
+
+	//handle to the uniform 'name', resolved now so setting it later needs no lookup
+	//reports names the program doesn't have (misspelled, or optimised out) and type mismatches
+	template <typename T>
+	UniformHandle<T> uniform(const std::string& name) const
+	{
+		UniformHandle<T> handle;
+		auto found = uniforms.find(name);
+		if (found == uniforms.end())
+		{
+			std::cout << "ERROR::SHADER::UNIFORM_NOT_FOUND: " << name << " (program " << ID << ")" << std::endl;
+			return handle;
+		}
+		if (!uniformTypeMatches<T>(found->second.type))
+			std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << " (program " << ID << ")" << std::endl;
+		found->second.used = true;
+		handle.location = found->second.location;
+		return handle;
+	}
+
+	//location of 'name', -1 without a message if the program doesn't have it (for optional uniforms)
+	GLint findUniform(const std::string& name) const
+	{
+		auto found = uniforms.find(name);
+		if (found == uniforms.end())
+			return -1;
+		found->second.used = true;
+		return found->second.location;
+	}
+
+	//report the active uniforms nothing has resolved or set so far, once the setup (and a first frame) is done
+	//such uniforms keep their default of zero, which is rarely what the shader expects
+	void checkUniforms(const std::string& shaderName) const
+	{
+		for (const auto& uniform : uniforms)
+		{
+			if (!uniform.second.used)
+				std::cout << "ERROR::SHADER::UNIFORM_NEVER_SET: " << uniform.first << " (" << shaderName << ")" << std::endl;
+		}
+	}
+
+	// utility uniform functions, by name through the reflected table (for setup code, the render loop uses handles)
 	void setBool(const std::string& name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(findUniform(name), (int)value);
 	}
 
 	// ------------------------------------------------------------------------
 	void setInt(const std::string& name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(findUniform(name), value);
 	}
 
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string& name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(findUniform(name), value);
 	}
 
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string& name, const glm::vec2& value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(findUniform(name), 1, &value[0]);
 	}
 	void setVec2(const std::string& name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(findUniform(name), x, y);
 	}
 
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string& name, const glm::vec3& value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(findUniform(name), 1, &value[0]);
 	}
 	void setVec3(const std::string& name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(findUniform(name), x, y, z);
 	}
 
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string& name, const glm::vec4& value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(findUniform(name), 1, &value[0]);
 	}
 	void setVec4(const std::string& name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(findUniform(name), x, y, z, w);
 	}
 
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string& name, const glm::mat2& mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(findUniform(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string& name, const glm::mat3& mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(findUniform(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string& name, const glm::mat4& mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(findUniform(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
+	//a build between submit() and resolve()
+	struct PendingBuild
+	{
+		bool pending = false;
+		//the program was handed a cached binary
+		bool fromCache = false;
+		bool binaries = false;
+		string cachePath;
+		uint64_t cacheKey = 0;
+		//source, type and (once compiled) shader object of every stage
+		vector<string> sources;
+		vector<GLenum> types;
+		vector<unsigned int> stages;
+		vector<string> feedbackVaryings;
+	} build;
+
+	//read the sources and start loading the cached binary, or compiling & linking, without querying any status
+	//(a status query makes the driver finish the work first)
+	void submit(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const vector<string>& feedbackVaryings)
+	{
+		//1. retrieve the vertex/fragment source code from filePath
+		std::string vertexCode;
+		std::string fragmentCode;
+		std::string geometryCode;
+		std::ifstream vShaderFile;
+		std::ifstream fShaderFile;
+		std::ifstream gShaderFile;
+		//ensure ifstream objects can throw exceptions:
+		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			//open files
+			vShaderFile.open(vertexPath);
+			std::stringstream vShaderStream;
+			//read file's buffer contents into streams
+			vShaderStream << vShaderFile.rdbuf();
+			//close file handlers
+			vShaderFile.close();
+			//convert stream into string
+			vertexCode = vShaderStream.str();
+			if (fragmentPath != nullptr)
+			{
+				fShaderFile.open(fragmentPath);
+				std::stringstream fShaderStream;
+				fShaderStream << fShaderFile.rdbuf();
+				fShaderFile.close();
+				fragmentCode = fShaderStream.str();
+			}
+			//if geometry shader path is present, also load a geometry shader
+			if (geometryPath != nullptr)
+			{
+				gShaderFile.open(geometryPath);
+				std::stringstream gShaderStream;
+				gShaderStream << gShaderFile.rdbuf();
+				gShaderFile.close();
+				geometryCode = gShaderStream.str();
+			}
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+		}
+
+		build.pending = true;
+		build.feedbackVaryings = feedbackVaryings;
+		vector<string> stagePaths = { vertexPath };
+		build.sources.push_back(vertexCode);
+		build.types.push_back(GL_VERTEX_SHADER);
+		if (fragmentPath != nullptr)
+		{
+			stagePaths.push_back(fragmentPath);
+			build.sources.push_back(fragmentCode);
+			build.types.push_back(GL_FRAGMENT_SHADER);
+		}
+		if (geometryPath != nullptr)
+		{
+			stagePaths.push_back(geometryPath);
+			build.sources.push_back(geometryCode);
+			build.types.push_back(GL_GEOMETRY_SHADER);
+		}
+
+		//2. load the linked program from the binary cache when the sources and driver are unchanged
+		build.binaries = programBinariesSupported();
+		build.cachePath = programCachePath(stagePaths);
+		build.cacheKey = programCacheKey({ vertexCode, fragmentCode, geometryCode }, feedbackVaryings);
+		ID = glCreateProgram();
+		build.fromCache = build.binaries && loadProgramBinary(build.cachePath, build.cacheKey, ID);
+		if (!build.fromCache)
+			compile();
+	}
+
+	//3. compile the stages and link them, the statuses are checked in checkBuild()
+	void compile()
+	{
+		for (size_t i = 0; i < build.sources.size(); i++)
+		{
+			const char* code = build.sources[i].c_str();
+			unsigned int stage = glCreateShader(build.types[i]);
+			glShaderSource(stage, 1, &code, NULL);
+			glCompileShader(stage);
+			glAttachShader(ID, stage);
+			build.stages.push_back(stage);
+		}
+		//transform feedback outputs have to be declared before linking
+		if (!build.feedbackVaryings.empty())
+		{
+			vector<const char*> names;
+			for (const string& varying : build.feedbackVaryings)
+				names.push_back(varying.c_str());
+			glTransformFeedbackVaryings(ID, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+		}
+		if (build.binaries)
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(ID);
+	}
+
+	//report the compile errors of every stage and the link errors, true if the program linked
+	bool checkBuild()
+	{
+		for (size_t i = 0; i < build.stages.size(); i++)
+		{
+			GLenum type = build.types[i];
+			checkCompileErrors(build.stages[i], type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "GEOMETRY");
+		}
+		return checkCompileErrors(ID, "PROGRAM");
+	}
+	//fill 'uniforms' & 'uniformBlocks' from the linked program
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			UniformInfo info = { -1, GL_NONE, 0, false };
+			glGetActiveUniform(ID, i, maxLength, &length, &info.size, &info.type, name.data());
+			string uniformName(name.data(), length);
+			//members of uniform blocks have no location, they're set through their buffer
+			GLuint index = static_cast<GLuint>(i);
+			GLint blockIndex = -1;
+			glGetActiveUniformsiv(ID, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+			if (blockIndex >= 0 || uniformName.compare(0, 3, "gl_") == 0)
+				continue;
+			info.location = glGetUniformLocation(ID, uniformName.c_str());
+			if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+				uniformName.resize(uniformName.size() - 3);
+			uniforms[uniformName] = info;
+		}
+
+		count = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLchar blockName[256];
+			GLsizei length = 0;
+			glGetActiveUniformBlockName(ID, i, sizeof(blockName), &length, blockName);
+			string name(blockName, length);
+			uniformBlocks[name] = static_cast<GLuint>(i);
+
+			bool shared = false;
+			for (GLuint binding = 0; binding < UNIFORM_BLOCK_BINDINGS; binding++)
+			{
+				if (name == uniformBlockNames[binding])
+				{
+					glUniformBlockBinding(ID, i, binding);
+					shared = true;
+				}
+			}
+			if (!shared)
+				std::cout << "ERROR::SHADER::UNKNOWN_UNIFORM_BLOCK: " << name << " (program " << ID << ")" << std::endl;
+		}
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
+	//true when the compile or link succeeded
+	bool checkCompileErrors(GLuint shader, std::string type)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -195,9 +472,104 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
+	}
+};
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//builds several programs side by side: shaders constructed with the batch only start their compile & link (or binary load)
+//and leave the status queries, which make the driver finish the work, to finish()
+//with GL_KHR_parallel_shader_compile (or the ARB version) the driver compiles on its own threads, so startup waits
+//about as long as the slowest program instead of the sum of all of them
+class ShaderBatch
+{
+public:
+	//'loader' resolves GL functions by name (e.g. glfwGetProcAddress), for the extension entry point glad doesn't load
+	explicit ShaderBatch(GLADloadproc loader = nullptr) : parallel(false)
+	{
+		if (loader == nullptr)
+			return;
+		typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+		GLint extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+		for (GLint i = 0; i < extensions && !parallel; i++)
+		{
+			const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			const char* function = nullptr;
+			if (name == nullptr)
+				continue;
+			if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+				function = "glMaxShaderCompilerThreadsKHR";
+			else if (strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+				function = "glMaxShaderCompilerThreadsARB";
+			else
+				continue;
+			MaxShaderCompilerThreadsProc maxThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(loader(function));
+			if (maxThreads)
+			{
+				//0xFFFFFFFF leaves the number of threads to the implementation
+				maxThreads(0xFFFFFFFF);
+				parallel = true;
+			}
+		}
+	}
+
+	void add(Shader* shader)
+	{
+		shaders.push_back(shader);
+	}
+
+	//resolve every submitted program
+	//with the extension, programs whose GL_COMPLETION_STATUS_KHR says they're done are resolved first and the oldest
+	//is only waited for when none is; without it they're resolved in order
+	void finish()
+	{
+		vector<Shader*> pending = shaders;
+		while (!pending.empty())
+		{
+			bool resolved = false;
+			for (size_t i = 0; parallel && i < pending.size();)
+			{
+				GLint done = GL_FALSE;
+				glGetProgramiv(pending[i]->ID, GL_COMPLETION_STATUS_KHR, &done);
+				if (done)
+				{
+					pending[i]->resolve();
+					pending.erase(pending.begin() + i);
+					resolved = true;
+				}
+				else
+				{
+					i++;
+				}
+			}
+			if (!resolved && !pending.empty())
+			{
+				pending.front()->resolve();
+				pending.erase(pending.begin());
+			}
+		}
+		shaders.clear();
 	}
+
+	//whether the driver compiles on its own threads
+	bool isParallel() const { return parallel; }
+
+private:
+	vector<Shader*> shaders;
+	bool parallel;
 };
 
+inline Shader::Shader(ShaderBatch& batch, const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+	const vector<string>& feedbackVaryings)
+{
+	submit(vertexPath, fragmentPath, geometryPath, feedbackVaryings);
+	batch.add(this);
+}
+
 #endif
 
 
@@ -8,6 +8,17 @@
 #include <stb_image.h>
 #include <Camera.h>
 #include <Model.h>
+#include <InstanceBuffer.h>
+#include <AsteroidField.h>
+#include <FrustumCuller.h>
+#include <ThreadPool.h>
+#include <GpuCuller.h>
+#include <ImpostorAtlas.h>
+#include <AsteroidGenerator.h>
+#include <AsteroidStream.h>
+#include <AsteroidFieldFile.h>
+#include <UniformBuffer.h>
+#include <TextureLoader.h>
 #include <filesystem>
 
 #include <iostream>
@@ -18,7 +29,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-unsigned int loadCubemap(vector<std::string> faces);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
 //screen
 const unsigned int screenWidth = 1400;
@@ -40,6 +51,20 @@ glm::vec3 lightColour(7.5f, 7.5f, 7.5f);
 float lightOrbitRadius = 1500.0f;
 float lightOrbitSpeed = 0.2f;
 
+//asteroid culling, G switches between the CPU and the GPU (transform feedback) path
+bool gpuCulling = false;
+
+//seed of the generated asteroid belt
+const uint64_t asteroidSeed = 1;
+//B switches to a far larger belt, of which only the chunks around the camera are generated and kept in memory
+bool streamedBelt = false;
+
+//asteroid level of detail, [ and ] shift the selection towards finer or coarser levels
+float lodBias = 0.0f;
+const unsigned int rockLodLevels = 4;
+//asteroids further away than this are drawn as octahedral impostors (0 disables them)
+float impostorDistance = 150.0f;
+
 //update window size
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -105,42 +130,24 @@ void processInput(GLFWwindow* window)
 		glfwSetWindowShouldClose(window, true);
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
+//toggles that should fire once per key press rather than every frame
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
 	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			GLenum format;
-			if (nrChannels == 1)
-				format = GL_RED;
-			else if (nrChannels == 3)
-				format = GL_RGB;
-			else if (nrChannels == 4)
-				format = GL_RGBA;
-
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
+		gpuCulling = !gpuCulling;
+		cout << "Asteroid culling: " << (gpuCulling ? "GPU" : "CPU") << endl;
+	}
+	if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS)
+	{
+		lodBias += key == GLFW_KEY_RIGHT_BRACKET ? 0.5f : -0.5f;
+		cout << "Asteroid LOD bias: " << lodBias << endl;
+	}
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		streamedBelt = !streamedBelt;
+		cout << "Asteroid belt: " << (streamedBelt ? "streamed" : "generated") << endl;
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
 }
 
 string getPath(const string& filename) {
@@ -172,6 +179,7 @@ int main()
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetKeyCallback(window, key_callback);
 
 	//check if glad has been successflly initialised
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -220,11 +228,31 @@ int main()
 	string skyboxFragment = getPath("Shaders/skybox.fragment");
 	string screenVertex = getPath("Shaders/screen.vertex");
 	string screenFragment = getPath("Shaders/screen.fragment");
-
-	Shader planetShader(planetVertex.c_str(), planetFragment.c_str());
-	Shader asteroidsShader(asteroidsVertex.c_str(), asteroidsFragment.c_str());
-	Shader skyboxShader(skyboxVertex.c_str(), skyboxFragment.c_str());
-	Shader screenShader(screenVertex.c_str(), screenFragment.c_str());
+	string cullVertex = getPath("Shaders/cull.vertex");
+	string cullGeometry = getPath("Shaders/cull.geometry");
+	string impostorVertex = getPath("Shaders/impostor.vertex");
+	string impostorFragment = getPath("Shaders/impostor.fragment");
+	string impostorBakeVertex = getPath("Shaders/impostorBake.vertex");
+	string impostorBakeFragment = getPath("Shaders/impostorBake.fragment");
+
+	//every program is submitted before any status is checked, so the driver can build them side by side
+	ShaderBatch shaderBatch((GLADloadproc)glfwGetProcAddress);
+	Shader planetShader(shaderBatch, planetVertex.c_str(), planetFragment.c_str());
+	Shader asteroidsShader(shaderBatch, asteroidsVertex.c_str(), asteroidsFragment.c_str());
+	Shader skyboxShader(shaderBatch, skyboxVertex.c_str(), skyboxFragment.c_str());
+	Shader screenShader(shaderBatch, screenVertex.c_str(), screenFragment.c_str());
+	Shader cullShader(shaderBatch, cullVertex.c_str(), nullptr, cullGeometry.c_str(), { "tfPosition", "tfPacked" });
+	Shader impostorShader(shaderBatch, impostorVertex.c_str(), impostorFragment.c_str());
+	Shader impostorBakeShader(shaderBatch, impostorBakeVertex.c_str(), impostorBakeFragment.c_str());
+	shaderBatch.finish();
+
+	//let the driver finish compiling every program now instead of stalling the first frame
+	unsigned int warmUpVAO;
+	glGenVertexArrays(1, &warmUpVAO);
+	for (const Shader* shader : { &planetShader, &asteroidsShader, &skyboxShader, &screenShader, &cullShader, &impostorShader,
+		&impostorBakeShader })
+		shader->warmUp(warmUpVAO);
+	glDeleteVertexArrays(1, &warmUpVAO);
 
 	/*
 		load textures
@@ -232,8 +260,34 @@ int main()
 	string planetPath = getPath("Resources/models/planet/planet.obj");
 	string rockPath = getPath("Resources/models/rock/rock.obj");
 
-	Model planet("Resources/models/planet/planet.obj");
-	Model rock(rockPath);
+	//images are decoded on worker threads while the models load, and show a placeholder until they're uploaded
+	//the mip levels of cooked textures are then kept resident by how large they appear, within 32 MB
+	TextureStreamer textureStreamer(32 * 1024 * 1024);
+	TextureLoader textureLoader(64 * 1024 * 1024, 0, &textureStreamer);
+
+	//load skybox texture
+	string right = getPath("Resources/textures/skybox/right.png");
+	string left = getPath("Resources/textures/skybox/left.png");
+	string top = getPath("Resources/textures/skybox/top.png");
+	string bottom = getPath("Resources/textures/skybox/bottom.png");
+	string front = getPath("Resources/textures/skybox/front.png");
+	string back = getPath("Resources/textures/skybox/back.png");
+
+	vector<std::string> faces {right, left, top, bottom, front, back};
+	unsigned int cubemapTexture = textureLoader.loadCubemap(faces);
+
+	Model planet("Resources/models/planet/planet.obj", false, 1, VERTEX_FORMAT_COMPACT, true, &textureLoader);
+	//the planet hides whatever is behind it, seen as a sphere just inside its faceted surface
+	float planetScale = 10.0f;
+	glm::vec3 planetCentre(0.0f, -1.2f * planetScale, 0.0f);
+	float planetOccluderRadius = planet.innerRadius() * planetScale;
+	//the rock is only drawn, so its CPU geometry is dropped once uploaded
+	Model rock(rockPath, false, rockLodLevels, VERTEX_FORMAT_QUANTIZED, false, &textureLoader);
+
+	//bake the rock from all around for the far impostor tier, which needs its real texture
+	for (const Texture& texture : rock.textures_loaded)
+		textureLoader.wait(texture.id);
+	ImpostorAtlas rockImpostor(rock, impostorBakeShader);
 
 	float skyboxVertices[] = {
 		// positions          
@@ -292,100 +346,32 @@ int main()
 		 1.0f,  1.0f,  1.0f, 1.0f
 	};
 
-	//load skybox texture
-	string right = getPath("Resources/textures/skybox/right.png");
-	string left = getPath("Resources/textures/skybox/left.png");
-	string top = getPath("Resources/textures/skybox/top.png");
-	string bottom = getPath("Resources/textures/skybox/bottom.png");
-	string front = getPath("Resources/textures/skybox/front.png");
-	string back = getPath("Resources/textures/skybox/back.png");
-
-	vector<std::string> faces {right, left, top, bottom, front, back};
-	unsigned int cubemapTexture = loadCubemap(faces);
-
-	//generate a large list of random model transformation matrices
+	//load the asteroid belt saved by an earlier run, or generate it (the same seed always gives the same belt) and save it
 	unsigned int amount = 10000;
-	glm::mat4* modelMatrices;
-	modelMatrices = new glm::mat4[amount];
-	srand(static_cast<unsigned int>(glfwGetTime())); //initialize random seed
-	float radius = 500.0;
-	float offset = 100.0f;
-
-	//generate random asteroid objects
-	for (unsigned int i = 0; i < amount; i++)
-	{
-		glm::mat4 model = glm::mat4(1.0f);
-
-		//displace along circle with 'radius' in range [-offset, offset]
-		float angle = (float)i / (float)amount * 360.0f;
-		float displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float x = sin(angle) * radius + displacement;
-		displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float y = displacement * 0.4f; //keep height of asteroid field smaller compared to width of x and z
-		displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float z = cos(angle) * radius + displacement;
-		model = glm::translate(model, glm::vec3(x, y, z));
-
-		//scale between 0.1 and 0.25f
-		float scale = static_cast<float>((rand() % 20) / 100.0 + 0.1);
-		model = glm::scale(model, glm::vec3(scale));
-
-		//add random rotation around a randomly picked rotation axis vector
-		float rotAngle = static_cast<float>((rand() % 360));
-		model = glm::rotate(model, rotAngle, glm::vec3(0.4f, 0.6f, 0.8f));
-
-		//add to list of matrices
-		modelMatrices[i] = model;
-	}
-	
-	//generate random asteroids rotation speed
-	vector<float> rotationSpeeds(amount);
-	for (auto& speed : rotationSpeeds)
+	AsteroidFieldParams asteroidParams = defaultAsteroidFieldParams(amount);
+	uint64_t asteroidKey = asteroidFieldKey(asteroidSeed, asteroidParams);
+	string asteroidFieldPath = getPath("Resources/asteroids/belt_" + to_string(asteroidSeed) + "_" + to_string(amount) + ".astf");
+	AsteroidField asteroidField;
+	ThreadPool threadPool;
+	if (!loadAsteroidField(asteroidFieldPath, asteroidField, rock.boundingRadius, asteroidKey))
 	{
-		speed = (rand() % 100) / 10.0f;
+		generateAsteroidField(asteroidSeed, asteroidParams, asteroidField, threadPool);
+		asteroidField.buildBounds(rock.boundingRadius, threadPool);
+		saveAsteroidField(asteroidFieldPath, asteroidField, rock.boundingRadius, asteroidKey);
 	}
 
-	//asteroids rotation speed VBO
-	unsigned int rotationVBO;
-	glGenBuffers(1, &rotationVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, rotationVBO);
-	glBufferData(GL_ARRAY_BUFFER, amount * sizeof(float), rotationSpeeds.data(), GL_STATIC_DRAW);
-
-	//planet VBO
-	unsigned int planetVBO;
-	glGenBuffers(1, &planetVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
-	glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
+	//the streamed belt: 20 million asteroids in 512 slices per speed, held in 64 MB at most
+	AsteroidFieldParams streamedParams = defaultAsteroidFieldParams(20000000);
+	streamedParams.rotationSpeedStep = 1.0f;
+	AsteroidStream asteroidStream(asteroidSeed, streamedParams, rock.boundingRadius, 512, 120.0f, 64 * 1024 * 1024);
 
-	//asteroids VAO
-	for (unsigned int i = 0; i < rock.meshes.size(); i++)
-	{
-		unsigned int asteroidsVAO = rock.meshes[i].VAO;
-		glBindVertexArray(asteroidsVAO);
-
-		//vertex attributes
-		GLsizei vec4Size = sizeof(glm::vec4);
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(1 * vec4Size));
-		glEnableVertexAttribArray(5);
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
-		glEnableVertexAttribArray(7);
-		glBindBuffer(GL_ARRAY_BUFFER, rotationVBO);
-		glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-
-		//update attributes once per instance
-		glVertexAttribDivisor(3, 1);
-		glVertexAttribDivisor(4, 1);
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-		glVertexAttribDivisor(7, 1);
-
-		glBindVertexArray(0);
-	}
+	//only the asteroids surviving culling are streamed to the GPU each frame
+	InstanceBuffer<AsteroidInstance> asteroidInstances(max(amount, asteroidStream.maxInstances()));
+	vector<unsigned int> visibleAsteroids;
+	vector<unsigned int> lodSortedAsteroids;
+	vector<unsigned int> lodFirst;
+	FrustumCuller asteroidCuller(threadPool);
+	GpuCuller gpuCuller(cullShader, asteroidField.instances, rock);
 
 	//skybox VAO & VBO
 	unsigned int skyboxVAO, skyboxVBO;
@@ -455,6 +441,36 @@ int main()
 	screenShader.use();
 	screenShader.setInt("screenTexture", 0);
 
+	//camera, time & light reach every program through the FrameData & LightData blocks, written once per frame
+	UniformRing<FrameData> frameUniforms(FRAME_DATA_BINDING);
+	UniformRing<LightData> lightUniforms(LIGHT_DATA_BINDING);
+	LightData light;
+	light.ambient = glm::vec4(0.1f);
+	light.diffuse = glm::vec4(0.8f);
+	light.specular = glm::vec4(0.05f);
+
+	//uniforms that never change are set once here, the ones set every frame go through handles resolved here
+	planetShader.use();
+	planetShader.setFloat("material.shininess", 64.0f);
+	//brighter and without highlights compared to the asteroids
+	planetShader.setFloat("material.diffuseStrength", 1.25f);
+	planetShader.setFloat("material.specularStrength", 0.0f);
+	UniformHandle<glm::mat4> planetModel = planetShader.uniform<glm::mat4>("model");
+	UniformHandle<glm::mat3> planetNormalMatrix = planetShader.uniform<glm::mat3>("modelMatrix");
+
+	asteroidsShader.use();
+	asteroidsShader.setInt("material.texture_diffuse1", 0);
+	asteroidsShader.setFloat("material.shininess", 64.0f);
+
+	impostorShader.use();
+	impostorShader.setFloat("material.shininess", 64.0f);
+	rockImpostor.setUniforms(impostorShader);
+
+	skyboxShader.use();
+	skyboxShader.setInt("skybox", 0);
+	//uniforms still unset after the first frame are reported once
+	bool uniformsChecked = false;
+
 	float planetRotationSpeed = 2.5f;
 
 	glfwMakeContextCurrent(window);
@@ -477,6 +493,9 @@ int main()
 
 		processInput(window);
 
+		//swap in the textures decoded since the last frame
+		textureLoader.update();
+
 		/*-
 			render
 		-*/
@@ -508,65 +527,143 @@ int main()
 		view = camera.GetViewMatrix();
 		projection = glm::perspective(glm::radians(45.0f),
 			(float)screenWidth / (float)screenHeight, 0.1f, 10000.0f);
-
-		asteroidsShader.use();
-
-		asteroidsShader.setMat4("view", camera.GetViewMatrix());
-		asteroidsShader.setMat4("projection", projection);
-		asteroidsShader.setFloat("uTime", currentFrame * 10.0f);
+		float asteroidTime = currentFrame * 10.0f;
+
+		FrameData frameData;
+		frameData.view = view;
+		frameData.projection = projection;
+		frameData.viewProj = projection * view;
+		frameData.cameraPos = camera.Position;
+		frameData.time = asteroidTime;
+		frameUniforms.update(frameData);
+		light.position = glm::vec4(lightPos, 1.0f);
+		lightUniforms.update(light);
+
+		//cull the asteroids against the view frustum
+		//and the planet, then pick each one's level of detail from its size on screen
+		Frustum frustum = extractFrustum(frameData.viewProj);
+		OcclusionCone planetShadow = makeOcclusionCone(camera.Position, planetCentre, planetOccluderRadius);
+		LodSettings lodSettings = makeLodSettings(rockLodLevels, glm::radians(45.0f), (float)screenHeight, lodBias, impostorDistance);
+		//the GPU culler reads a static copy of the generated belt, so the streamed one always takes the CPU path
+		if (streamedBelt)
+			asteroidStream.update(camera.Position, asteroidTime);
+		AsteroidField& belt = streamedBelt ? asteroidStream.field() : asteroidField;
+
+		//keep the texture levels resident that the planet and the nearest asteroids need at their size on screen
+		float planetDistance = max(glm::length(camera.Position - planetCentre), planet.boundingRadius * planetScale);
+		for (const Texture& texture : planet.textures_loaded)
+			textureStreamer.request(texture.id, 2.0f * planet.boundingRadius * planetScale * lodSettings.pixelScale / planetDistance);
+		//the closest an asteroid can be is the distance to the belt's ring volume
+		const AsteroidFieldParams& beltParams = streamedBelt ? streamedParams : asteroidParams;
+		float ringDistance = max(0.0f, fabs(glm::length(glm::vec2(camera.Position.x, camera.Position.z)) - beltParams.radius) - beltParams.offset);
+		float heightDistance = max(0.0f, fabs(camera.Position.y) - beltParams.offset * beltParams.heightFactor);
+		float rockRadius = rock.boundingRadius * beltParams.maxScale;
+		float rockDistance = max(sqrt(ringDistance * ringDistance + heightDistance * heightDistance), rockRadius);
+		for (const Texture& texture : rock.textures_loaded)
+			textureStreamer.request(texture.id, 2.0f * rockRadius * lodSettings.pixelScale / rockDistance);
+		textureStreamer.update();
+		bool cullOnGpu = gpuCulling && !streamedBelt;
+		//whole sectors first, then the asteroids of the sectors that are only partly visible
+		belt.cullSectors(frustum, planetShadow, asteroidTime, threadPool);
+		if (cullOnGpu)
+		{
+			gpuCuller.cull(belt.visibleRuns(), frustum, planetShadow, rock.boundingRadius * 1.01f, lodSettings);
+		}
+		else
+		{
+			//compact the visible ones into the instance buffer, grouped by level
+			belt.cullInstances(asteroidCuller, visibleAsteroids);
+			belt.sortByLod(visibleAsteroids, lodSettings, lodSortedAsteroids, lodFirst, threadPool);
+			unsigned int visibleCount = static_cast<unsigned int>(lodSortedAsteroids.size());
+			asteroidInstances.resize(visibleCount);
+			belt.gather(lodSortedAsteroids, asteroidInstances.data(), threadPool);
+			asteroidInstances.markDirty(0, visibleCount);
+		}
 
 		planetShader.use();
-		planetShader.setMat4("view", camera.GetViewMatrix());
-		planetShader.setMat4("projection", projection);
 
 		//render planet
 		float planetRotationAngle = currentFrame * planetRotationSpeed;
 
 		model = glm::mat4(1.0f); //reset as identity matrix
-		model = glm::scale(model, glm::vec3(10.0f, 10.0f, 10.0f));
+		model = glm::scale(model, glm::vec3(planetScale));
 		model = glm::rotate(model, glm::radians(planetRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); //rotate along y-axis
 		model = glm::translate(model, glm::vec3(0.0f, -1.2f, 0.0f));
 		glm::mat3 modelMatrix = glm::mat3(transpose(inverse(model)));
-		planetShader.setMat4("model", model);
-		planetShader.setMat3("modelMatrix", modelMatrix);
-
-		planetShader.setFloat("material.shininess", 64.0f);
-
-		planetShader.setVec3("light.position", lightPos);
-		planetShader.setVec3("light.ambient", glm::vec3(0.1f));
-		planetShader.setVec3("light.diffuse", glm::vec3(1.0f));
-		planetShader.setVec3("light.specular", glm::vec3(0.0f));
+		planetModel.set(model);
+		planetNormalMatrix.set(modelMatrix);
 		planet.Draw(planetShader);
 
 		//render asteroids
 		asteroidsShader.use();
-		asteroidsShader.setInt("material.texture_diffuse1", 0);
-		asteroidsShader.setFloat("material.shininess", 64.0);
-
-		asteroidsShader.setVec3("light.lightPos", lightPos);
-		asteroidsShader.setVec3("light.ambient", glm::vec3(0.1f));
-		asteroidsShader.setVec3("light.diffuse", glm::vec3(0.8f));
-		asteroidsShader.setVec3("light.specular", glm::vec3(0.05f));
-
-		asteroidsShader.setVec3("cameraPos", camera.Position);
 
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, rock.textures_loaded[0].id);
+		glBindSampler(0, materialSampler());
 
-		for (unsigned int i = 0; i < rock.meshes.size(); i++)
+		if (cullOnGpu)
 		{
-			glBindVertexArray(rock.meshes[i].VAO);
-			glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(rock.meshes[i].indices.size()),
-				GL_UNSIGNED_INT, 0, amount);
-			glBindVertexArray(0);
+			//instances come straight from the transform feedback output of the cull pass
+			gpuCuller.draw(rock, asteroidsShader);
+		}
+		else
+		{
+			//upload the instances changed since this ring region was last used
+			asteroidInstances.beginFrame();
+
+			//one draw per level and mesh, each starting at its level's instances
+			for (unsigned int l = 0; l < rockLodLevels; l++)
+			{
+				unsigned int lodCount = lodFirst[l + 1] - lodFirst[l];
+				if (lodCount == 0 || rock.meshes.empty())
+					continue;
+				//the rock's meshes share one arena VAO, the instance attributes are attached to it once per level
+				setupAsteroidInstanceAttributes(rock.meshes[0].VAO, asteroidInstances.ID,
+					asteroidInstances.offset() + lodFirst[l] * sizeof(AsteroidInstance));
+				glBindVertexArray(rock.meshes[0].VAO);
+				for (unsigned int i = 0; i < rock.meshes.size(); i++)
+				{
+					const Mesh& mesh = rock.meshes[i];
+					const MeshLod& lod = mesh.lods[min(l, static_cast<unsigned int>(mesh.lods.size()) - 1)];
+					mesh.setPositionDecode(asteroidsShader);
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, mesh.indexType, mesh.indexOffset(lod), lodCount,
+						mesh.baseVertex);
+				}
+				glBindVertexArray(0);
+			}
+
+		}
+
+		glBindSampler(0, 0);
+
+		//far asteroids as impostor quads, lit by the same light
+		impostorShader.use();
+		rockImpostor.bind();
+
+		if (cullOnGpu)
+		{
+			gpuCuller.drawImpostors(rockImpostor.VAO);
+		}
+		else
+		{
+			unsigned int impostorCount = lodFirst[rockLodLevels + 1] - lodFirst[rockLodLevels];
+			if (impostorCount > 0)
+			{
+				setupAsteroidInstanceAttributes(rockImpostor.VAO, asteroidInstances.ID,
+					asteroidInstances.offset() + lodFirst[rockLodLevels] * sizeof(AsteroidInstance));
+				glBindVertexArray(rockImpostor.VAO);
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, impostorCount);
+				glBindVertexArray(0);
+			}
+
+			//fence the region so it isn't overwritten while the GPU still reads it
+			asteroidInstances.endFrame();
 		}
 
 		//draw skybox as last
 		glDepthFunc(GL_LEQUAL);  //change depth function so depth test passes when values are equal to depth buffer's content
+		//the translation is removed from the view matrix in skybox.vertex
 		skyboxShader.use();
-		view = glm::mat4(glm::mat3(camera.GetViewMatrix())); //remove translation from the view matrix
-		skyboxShader.setMat4("view", view);
-		skyboxShader.setMat4("projection", projection);
 		//skybox cube
 		glBindVertexArray(skyboxVAO);
 		glActiveTexture(GL_TEXTURE0);
@@ -590,18 +687,38 @@ int main()
 		glBindTexture(GL_TEXTURE_2D, screenTexture);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 
+		if (!uniformsChecked)
+		{
+			planetShader.checkUniforms("planet");
+			asteroidsShader.checkUniforms("asteroids");
+			skyboxShader.checkUniforms("skybox");
+			screenShader.checkUniforms("screen");
+			cullShader.checkUniforms("cull");
+			impostorShader.checkUniforms("impostor");
+			impostorBakeShader.checkUniforms("impostorBake");
+			uniformsChecked = true;
+		}
+
+		frameUniforms.endFrame();
+		lightUniforms.endFrame();
+
 		//check if evens have been triggered, and swap colour buffer
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
 	//clear pre-allocated resources
-	delete[] modelMatrices;
+	asteroidInstances.release();
+	gpuCuller.release();
+	rockImpostor.release();
+	frameUniforms.release();
+	lightUniforms.release();
+	planet.releaseTextures();
+	rock.releaseTextures();
+	textureLoader.release();
 
 	glDeleteVertexArrays(1, &skyboxVAO);
 	glDeleteVertexArrays(1, &screenVAO); 
-	glDeleteBuffers(1, &rotationVBO);
-	glDeleteBuffers(1, &planetVBO);
 	glDeleteBuffers(1, &skyboxVBO);
 	glDeleteBuffers(1, &screenVBO);
 	glDeleteFramebuffers(1, &FBO);
@@ -0,0 +1,438 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+#include <Hash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+//source images cooked into block-compressed DDS files next to them (e.g. rock.jpg.dds) on first load:
+//BC1 (DXT1, 4 bits per pixel) for opaque images, BC3 (DXT5, 8 bits per pixel) when any pixel is translucent,
+//with the full mip chain precomputed so nothing is generated at runtime
+//the file is keyed on the source's contents (kept in the header's reserved words), any change cooks it again
+const uint32_t textureCookerVersion = 1;
+//largest width or height a cooked file may claim, anything beyond is taken as a damaged header
+const uint32_t maxCookedTextureSize = 16384;
+
+//block-compressed image and its mip chain, level by level in 'data'
+struct CompressedImage
+{
+	//GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	GLenum format = GL_NONE;
+	int width = 0, height = 0;
+	vector<unsigned char> data;
+	vector<size_t> levelBytes;
+};
+
+//DDS layout, as documented for DirectX
+struct DdsPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask, gBitMask, bBitMask, aBitMask;
+};
+
+struct DdsHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	//[0] & [1] the source key, [2] textureCookerVersion
+	uint32_t reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t caps, caps2, caps3, caps4;
+	uint32_t reserved2;
+};
+
+static_assert(sizeof(DdsPixelFormat) == 32 && sizeof(DdsHeader) == 124, "DdsHeader doesn't match the DDS layout");
+
+const uint32_t ddsMagic = 0x20534444;
+const uint32_t ddsFourCCDxt1 = 0x31545844;
+const uint32_t ddsFourCCDxt5 = 0x35545844;
+
+//whether the context exposes the extension 'extension' (e.g. "GL_EXT_texture_compression_s3tc")
+bool glExtensionSupported(const char* extension)
+{
+	GLint extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+	for (GLint i = 0; i < extensions; i++)
+	{
+		const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (name != nullptr && strcmp(name, extension) == 0)
+			return true;
+	}
+	return false;
+}
+
+//whether the driver takes S3TC textures (EXT_texture_compression_s3tc, on virtually every desktop GPU but not core GL)
+bool textureCompressionSupported()
+{
+	return glExtensionSupported("GL_EXT_texture_compression_s3tc");
+}
+
+//bytes of a 'width' x 'height' level, in 4x4 blocks of 8 (BC1) or 16 (BC3) bytes
+size_t compressedLevelBytes(GLenum format, int width, int height)
+{
+	size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+//nearest RGB565 colour, and back to 8 bits per channel
+uint16_t packRgb565(const float rgb[3])
+{
+	int r = min(31, max(0, int(rgb[0] * 31.0f / 255.0f + 0.5f)));
+	int g = min(63, max(0, int(rgb[1] * 63.0f / 255.0f + 0.5f)));
+	int b = min(31, max(0, int(rgb[2] * 31.0f / 255.0f + 0.5f)));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t colour, int rgb[3])
+{
+	int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+//BC1 colour block of 16 RGBA pixels (alpha ignored), always in the four colour mode
+//endpoints are the extremes of the pixels along their principal axis, inset by 1/16 of the range
+void encodeColourBlock(const unsigned char pixels[64], unsigned char out[8])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += pixels[i * 4 + c] / 16.0f;
+	float covariance[6] = { 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { pixels[i * 4] - mean[0], pixels[i * 4 + 1] - mean[1], pixels[i * 4 + 2] - mean[2] };
+		covariance[0] += d[0] * d[0];
+		covariance[1] += d[0] * d[1];
+		covariance[2] += d[0] * d[2];
+		covariance[3] += d[1] * d[1];
+		covariance[4] += d[1] * d[2];
+		covariance[5] += d[2] * d[2];
+	}
+	//a few power iterations are plenty for a 3x3 matrix
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[3] = {
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+		float length = max(fabs(next[0]), max(fabs(next[1]), fabs(next[2])));
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float lowest = 1e30f, highest = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (pixels[i * 4] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1] + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+		lowest = min(lowest, t);
+		highest = max(highest, t);
+	}
+	float inset = (highest - lowest) / 16.0f;
+	float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float scale = axisLength > 0.0f ? 1.0f / axisLength : 0.0f;
+	float maxColour[3], minColour[3];
+	for (int c = 0; c < 3; c++)
+	{
+		maxColour[c] = mean[c] + axis[c] * (highest - inset) * scale;
+		minColour[c] = mean[c] + axis[c] * (lowest + inset) * scale;
+	}
+
+	uint16_t colour0 = packRgb565(maxColour), colour1 = packRgb565(minColour);
+	if (colour0 < colour1)
+		swap(colour0, colour1);
+	int palette[4][3];
+	unpackRgb565(colour0, palette[0]);
+	unpackRgb565(colour1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	uint32_t indices = 0;
+	//equal endpoints would mean the three colour mode, where every index 0 still gives colour0
+	if (colour0 != colour1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestDistance = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = pixels[i * 4] - palette[p][0], dg = pixels[i * 4 + 1] - palette[p][1], db = pixels[i * 4 + 2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= uint32_t(best) << (i * 2);
+		}
+	}
+	out[0] = colour0 & 0xFF;
+	out[1] = colour0 >> 8;
+	out[2] = colour1 & 0xFF;
+	out[3] = colour1 >> 8;
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+//BC3 alpha block of 16 RGBA pixels, in the eight value mode between the lowest & highest alpha
+void encodeAlphaBlock(const unsigned char pixels[64], unsigned char out[8])
+{
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = max(alpha0, int(pixels[i * 4 + 3]));
+		alpha1 = min(alpha1, int(pixels[i * 4 + 3]));
+	}
+	uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		int palette[8] = { alpha0, alpha1 };
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestDistance = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int distance = abs(pixels[i * 4 + 3] - palette[p]);
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (i * 3);
+		}
+	}
+	out[0] = static_cast<unsigned char>(alpha0);
+	out[1] = static_cast<unsigned char>(alpha1);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+//append one level of RGBA 'pixels' compressed to 'format' to 'image'
+void compressLevel(const unsigned char* pixels, int width, int height, GLenum format, CompressedImage& image)
+{
+	size_t start = image.data.size();
+	size_t bytes = compressedLevelBytes(format, width, height);
+	image.data.resize(start + bytes);
+	image.levelBytes.push_back(bytes);
+	unsigned char* out = image.data.data() + start;
+	unsigned char block[64];
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			//blocks over the edge repeat the last row & column
+			for (int y = 0; y < 4; y++)
+			{
+				for (int x = 0; x < 4; x++)
+				{
+					const unsigned char* pixel = pixels + (size_t(min(by + y, height - 1)) * width + min(bx + x, width - 1)) * 4;
+					memcpy(block + (y * 4 + x) * 4, pixel, 4);
+				}
+			}
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			{
+				encodeAlphaBlock(block, out);
+				out += 8;
+			}
+			encodeColourBlock(block, out);
+			out += 8;
+		}
+	}
+}
+
+//compress 'width' x 'height' RGBA pixels, BC3 if any pixel is translucent and BC1 otherwise,
+//with every mip level down to 1x1 (2x2 box filtered) when 'mipmaps' is set
+void compressImage(const unsigned char* pixels, int width, int height, bool mipmaps, CompressedImage& image)
+{
+	bool translucent = false;
+	for (size_t i = 0; i < size_t(width) * height && !translucent; i++)
+		translucent = pixels[i * 4 + 3] != 255;
+	image.format = translucent ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	image.width = width;
+	image.height = height;
+	image.data.clear();
+	image.levelBytes.clear();
+	compressLevel(pixels, width, height, image.format, image);
+
+	vector<unsigned char> level(pixels, pixels + size_t(width) * height * 4), next;
+	while (mipmaps && (width > 1 || height > 1))
+	{
+		int nextWidth = max(1, width / 2), nextHeight = max(1, height / 2);
+		next.resize(size_t(nextWidth) * nextHeight * 4);
+		for (int y = 0; y < nextHeight; y++)
+		{
+			int y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+			for (int x = 0; x < nextWidth; x++)
+			{
+				int x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+				for (int c = 0; c < 4; c++)
+				{
+					int sum = level[(size_t(y0) * width + x0) * 4 + c] + level[(size_t(y0) * width + x1) * 4 + c]
+						+ level[(size_t(y1) * width + x0) * 4 + c] + level[(size_t(y1) * width + x1) * 4 + c];
+					next[(size_t(y) * nextWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		level.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+		compressLevel(level.data(), width, height, image.format, image);
+	}
+}
+
+//load the cooked file at 'path' into 'image', false if there is none for 'key'
+bool loadCompressedTexture(const string& path, uint64_t key, CompressedImage& image)
+{
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file)
+		return false;
+	size_t fileBytes = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+	uint32_t magic = 0;
+	DdsHeader header;
+	if (fileBytes < sizeof(magic) + sizeof(header))
+		return false;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	uint32_t fourCC = header.pixelFormat.fourCC;
+	if (!file || magic != ddsMagic || header.size != sizeof(header) || (fourCC != ddsFourCCDxt1 && fourCC != ddsFourCCDxt5))
+	{
+		cout << "ERROR::TEXTURE_COOKER::INVALID_FILE: " << path << endl;
+		return false;
+	}
+	if (header.reserved1[0] != uint32_t(key) || header.reserved1[1] != uint32_t(key >> 32) || header.reserved1[2] != textureCookerVersion)
+		return false;
+
+	//the header drives the allocation below, so it must describe a sane image before anything is sized from it
+	if (header.width == 0 || header.height == 0 || header.width > maxCookedTextureSize || header.height > maxCookedTextureSize)
+	{
+		cout << "ERROR::TEXTURE_COOKER::INVALID_FILE: " << path << endl;
+		return false;
+	}
+	uint32_t maxLevels = static_cast<uint32_t>(floor(log2(static_cast<double>(max(header.width, header.height))))) + 1;
+	uint32_t levels = min(max(1u, header.mipMapCount), maxLevels);
+
+	image.format = fourCC == ddsFourCCDxt1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	image.width = header.width;
+	image.height = header.height;
+	image.levelBytes.clear();
+	size_t total = 0;
+	int width = image.width, height = image.height;
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		image.levelBytes.push_back(compressedLevelBytes(image.format, width, height));
+		total += image.levelBytes.back();
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+	//a cooked file holds exactly its levels, anything else (truncated, or a clamped level count) is cooked again
+	if (sizeof(magic) + sizeof(header) + total != fileBytes)
+	{
+		cout << "ERROR::TEXTURE_COOKER::INVALID_FILE: " << path << endl;
+		return false;
+	}
+	image.data.resize(total);
+	file.read(reinterpret_cast<char*>(image.data.data()), total);
+	return static_cast<bool>(file);
+}
+
+//save 'image' to 'path' as a DDS file keyed on 'key'
+bool saveCompressedTexture(const string& path, uint64_t key, const CompressedImage& image)
+{
+	DdsHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(header);
+	//caps, height, width, pixel format, mip count & linear size
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = static_cast<uint32_t>(image.levelBytes.front());
+	header.mipMapCount = static_cast<uint32_t>(image.levelBytes.size());
+	header.reserved1[0] = uint32_t(key);
+	header.reserved1[1] = uint32_t(key >> 32);
+	header.reserved1[2] = textureCookerVersion;
+	header.pixelFormat.size = sizeof(header.pixelFormat);
+	//four character code
+	header.pixelFormat.flags = 0x4;
+	header.pixelFormat.fourCC = image.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? ddsFourCCDxt1 : ddsFourCCDxt5;
+	//texture, plus complex & mipmap with more than one level
+	header.caps = 0x1000 | (header.mipMapCount > 1 ? 0x8 | 0x400000 : 0);
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+	{
+		cout << "ERROR::TEXTURE_COOKER::FILE_NOT_WRITABLE: " << path << endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&ddsMagic), sizeof(ddsMagic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+	if (!file)
+	{
+		cout << "ERROR::TEXTURE_COOKER::WRITE_FAILED: " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+//compressed version of the image at 'path', from its cooked file or cooked (and saved) now
+//false if the image can't be read, safe to call from worker threads
+bool cookTexture(const string& path, bool mipmaps, CompressedImage& image)
+{
+	uint64_t key = hashBytes(&textureCookerVersion, sizeof(textureCookerVersion));
+	key = hashBytes(&mipmaps, sizeof(mipmaps), key);
+	if (!hashFile(path, key))
+		return false;
+	string cachePath = path + ".dds";
+	if (loadCompressedTexture(cachePath, key, image))
+		return true;
+
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (!pixels)
+		return false;
+	compressImage(pixels, width, height, mipmaps, image);
+	stbi_image_free(pixels);
+	saveCompressedTexture(cachePath, key, image);
+	return true;
+}
+
+#endif
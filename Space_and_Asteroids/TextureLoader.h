@@ -0,0 +1,362 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+#include <TextureCooker.h>
+#include <TextureStreamer.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+//format & internal format of an image with 'channels' 8-bit channels
+GLenum textureFormat(int channels)
+{
+	if (channels == 1)
+		return GL_RED;
+	if (channels == 2)
+		return GL_RG;
+	if (channels == 4)
+		return GL_RGBA;
+	return GL_RGB;
+}
+
+//image decoded on a worker, waiting for its upload on the GL thread
+struct DecodedImage
+{
+	//GL_TEXTURE_2D or one of the GL_TEXTURE_CUBE_MAP_* faces
+	GLenum target = GL_TEXTURE_2D;
+	string path;
+	int width = 0, height = 0, channels = 0;
+	//from stbi_load, null if the file couldn't be decoded or was compressed
+	unsigned char* pixels = nullptr;
+	//cooked version of the image, used instead of 'pixels' when it has data
+	CompressedImage compressed;
+};
+
+//loads textures without blocking the GL thread on decoding
+//each load returns a texture id at once, holding a 1x1 placeholder, and decodes the images on worker threads;
+//update() then streams the decoded pixels through a pixel buffer object into the same texture id, so meshes and
+//materials holding the id pick up the real image without noticing
+//a texture is uploaded once all its images are decoded (a cube map whose faces differ in size is incomplete)
+//where the driver supports S3TC, images are cooked to BC1/BC3 (see TextureCooker.h) instead of decoded every launch,
+//and cooked 2D textures are handed to 'streamer' (if any), which keeps only the mip levels in use resident
+class TextureLoader
+{
+public:
+	//'uploadBytesPerFrame' bounds the bytes update() uploads per call (at least one texture is always uploaded)
+	TextureLoader(size_t uploadBytesPerFrame = 64 * 1024 * 1024, unsigned int threadCount = 0, TextureStreamer* streamer = nullptr)
+		: uploadBytesPerFrame(uploadBytesPerFrame), compress(textureCompressionSupported()), streamer(streamer), decoding(0),
+		PBO(0), workers(threadCount)
+	{
+	}
+
+	//waits for the decodes still running, whose images are then dropped
+	~TextureLoader()
+	{
+		unique_lock<mutex> lock(pendingMutex);
+		readyCondition.wait(lock, [this] { return decoding == 0; });
+		for (auto& texture : pending)
+		{
+			for (DecodedImage& image : texture.second.images)
+				stbi_image_free(image.pixels);
+		}
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	//2D texture of the image at 'path', repeating and trilinear, with mipmaps once it arrives
+	unsigned int load2D(const string& path)
+	{
+		unsigned int textureID = createPlaceholder(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		//the placeholder has no mipmaps, it's only complete for mipmap filtering (e.g. materialSampler) with one level
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		submit(textureID, GL_TEXTURE_2D, { path });
+		return textureID;
+	}
+
+	//cube map of six faces, in the order +X, -X, +Y, -Y, +Z, -Z
+	unsigned int loadCubemap(const vector<string>& faces)
+	{
+		unsigned int textureID = createPlaceholder(GL_TEXTURE_CUBE_MAP);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		submit(textureID, GL_TEXTURE_CUBE_MAP, faces);
+		return textureID;
+	}
+
+	//upload the textures decoded so far, up to the per frame budget, call once per frame on the GL thread
+	void update()
+	{
+		size_t uploaded = 0;
+		while (uploaded < uploadBytesPerFrame)
+		{
+			PendingTexture texture;
+			unsigned int textureID;
+			if (!takeReady(textureID, texture))
+				break;
+			uploaded += upload(textureID, texture);
+		}
+	}
+
+	//block until 'textureID' holds its real image, uploading whatever becomes ready meanwhile
+	//for textures needed before the first frame (e.g. baking the impostor atlas)
+	void wait(unsigned int textureID)
+	{
+		while (isPending(textureID))
+		{
+			PendingTexture texture;
+			unsigned int readyID;
+			{
+				unique_lock<mutex> lock(pendingMutex);
+				readyCondition.wait(lock, [this] { return !ready.empty(); });
+			}
+			while (takeReady(readyID, texture))
+				upload(readyID, texture);
+		}
+	}
+
+	//whether 'textureID' still holds its placeholder
+	bool isPending(unsigned int textureID)
+	{
+		lock_guard<mutex> lock(pendingMutex);
+		return pending.count(textureID) != 0;
+	}
+
+	//forget 'textureID' before it's deleted: stop streaming it and drop its images if it's still loading
+	//waits for decodes of it still running, as the texture id may be reused as soon as it's deleted
+	void forget(unsigned int textureID)
+	{
+		if (streamer)
+			streamer->remove(textureID);
+		unique_lock<mutex> lock(pendingMutex);
+		auto found = pending.find(textureID);
+		if (found == pending.end())
+			return;
+		readyCondition.wait(lock, [&] { return found->second.images.size() == found->second.imageCount; });
+		for (DecodedImage& image : found->second.images)
+			stbi_image_free(image.pixels);
+		pending.erase(found);
+		ready.erase(remove(ready.begin(), ready.end(), textureID), ready.end());
+	}
+
+	//free the pixel buffer, must be called while the context is still alive
+	void release()
+	{
+		glDeleteBuffers(1, &PBO);
+		PBO = 0;
+	}
+
+private:
+	//a texture whose images are being decoded
+	struct PendingTexture
+	{
+		//GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+		GLenum target = GL_TEXTURE_2D;
+		unsigned int imageCount = 0;
+		vector<DecodedImage> images;
+	};
+
+	size_t uploadBytesPerFrame;
+	//whether images are cooked to compressed formats
+	bool compress;
+	TextureStreamer* streamer;
+	//textures by id, guarded by pendingMutex
+	unordered_map<unsigned int, PendingTexture> pending;
+	//ids of pending textures whose images are all decoded
+	deque<unsigned int> ready;
+	//decodes queued or running
+	unsigned int decoding;
+	mutex pendingMutex;
+	condition_variable readyCondition;
+	unsigned int PBO;
+	//last member, so its threads are joined before anything they use is destroyed
+	ThreadPool workers;
+
+	//new texture bound to 'target' with a 1x1 mid grey image (on every face of a cube map)
+	unsigned int createPlaceholder(GLenum target)
+	{
+		const unsigned char grey[4] = { 128, 128, 128, 255 };
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(target, textureID);
+		if (target == GL_TEXTURE_CUBE_MAP)
+		{
+			for (unsigned int i = 0; i < 6; i++)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		}
+		else
+		{
+			glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		}
+		return textureID;
+	}
+
+	//queue the decodes of 'paths', the images of 'textureID'
+	void submit(unsigned int textureID, GLenum target, const vector<string>& paths)
+	{
+		{
+			lock_guard<mutex> lock(pendingMutex);
+			PendingTexture& texture = pending[textureID];
+			texture.target = target;
+			texture.imageCount = static_cast<unsigned int>(paths.size());
+			decoding += texture.imageCount;
+		}
+		for (unsigned int i = 0; i < paths.size(); i++)
+		{
+			GLenum imageTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : target;
+			string path = paths[i];
+			workers.submit([this, textureID, imageTarget, path]()
+				{
+					DecodedImage image;
+					image.target = imageTarget;
+					image.path = path;
+					//only 2D textures sample their mip levels, the skybox is always magnified
+					if (!compress || !cookTexture(path, imageTarget == GL_TEXTURE_2D, image.compressed))
+						image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+					lock_guard<mutex> lock(pendingMutex);
+					PendingTexture& texture = pending[textureID];
+					texture.images.push_back(image);
+					if (texture.images.size() == texture.imageCount)
+						ready.push_back(textureID);
+					decoding--;
+					readyCondition.notify_all();
+				});
+		}
+	}
+
+	//take the oldest texture whose images are all decoded, false if there is none
+	bool takeReady(unsigned int& textureID, PendingTexture& texture)
+	{
+		lock_guard<mutex> lock(pendingMutex);
+		if (ready.empty())
+			return false;
+		textureID = ready.front();
+		ready.pop_front();
+		auto found = pending.find(textureID);
+		texture = move(found->second);
+		pending.erase(found);
+		return true;
+	}
+
+	//upload every image of 'texture' into 'textureID' and free them, returns the bytes uploaded
+	size_t upload(unsigned int textureID, PendingTexture& texture)
+	{
+		if (PBO == 0)
+			glGenBuffers(1, &PBO);
+		size_t uploaded = 0;
+		bool complete = true;
+		bool compressed = false;
+		glBindTexture(texture.target, textureID);
+		//rows of 1 & 3 channel images aren't always 4-byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (DecodedImage& image : texture.images)
+		{
+			if (!image.compressed.data.empty())
+			{
+				uploaded += uploadCompressed(textureID, image);
+				compressed = true;
+				continue;
+			}
+			if (!image.pixels)
+			{
+				cout << "Texture failed to load at path: " << image.path << endl;
+				complete = false;
+				continue;
+			}
+			size_t bytes = size_t(image.width) * image.height * image.channels;
+			//orphan the buffer, so an upload still reading the previous image doesn't stall the copy
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+			void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			//with the pixel buffer bound the last argument is an offset into it, and the transfer to the texture
+			//happens asynchronously instead of inside glTexImage2D
+			const void* source = nullptr;
+			if (ptr)
+				memcpy(ptr, image.pixels, bytes);
+			if (!ptr || !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				source = image.pixels;
+			}
+			GLenum format = textureFormat(image.channels);
+			//cube faces keep the RGB internal format the skybox always had
+			GLenum internalFormat = texture.target == GL_TEXTURE_CUBE_MAP ? GL_RGB : format;
+			glTexImage2D(image.target, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			stbi_image_free(image.pixels);
+			image.pixels = nullptr;
+			uploaded += bytes;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		//cooked images bring their mip chain
+		if (complete && texture.target == GL_TEXTURE_2D && !compressed)
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		glBindTexture(texture.target, 0);
+		return uploaded;
+	}
+
+	//upload every level of a cooked image into 'textureID', which is bound, returns the bytes uploaded
+	size_t uploadCompressed(unsigned int textureID, DecodedImage& image)
+	{
+		const CompressedImage& compressed = image.compressed;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, compressed.data.size(), NULL, GL_STREAM_DRAW);
+		void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, compressed.data.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		const unsigned char* source = nullptr;
+		if (ptr)
+			memcpy(ptr, compressed.data.data(), compressed.data.size());
+		if (!ptr || !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			source = compressed.data.data();
+		}
+		int width = compressed.width, height = compressed.height;
+		size_t offset = 0;
+		for (size_t level = 0; level < compressed.levelBytes.size(); level++)
+		{
+			glCompressedTexImage2D(image.target, static_cast<GLint>(level), compressed.format, width, height, 0,
+				static_cast<GLsizei>(compressed.levelBytes[level]), source + offset);
+			offset += compressed.levelBytes[level];
+			width = max(1, width / 2);
+			height = max(1, height / 2);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		size_t bytes = compressed.data.size();
+		if (image.target == GL_TEXTURE_2D)
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levelBytes.size()) - 1);
+			//the streamer keeps the levels to upload them again after freeing them
+			if (streamer)
+				streamer->add(textureID, move(image.compressed));
+		}
+		image.compressed = CompressedImage();
+		return bytes;
+	}
+};
+
+#endif
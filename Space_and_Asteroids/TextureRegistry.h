@@ -0,0 +1,120 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <Hash.h>
+#include <TextureLoader.h>
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma);
+
+//every 2D texture of the process, shared by all models
+//textures are found by canonical path first and by a hash of the file's contents second, so the same image reached
+//through different paths (or stored twice under different names) is decoded and uploaded once
+//each acquire() holds a reference, the GL texture is deleted when the last one is released
+class TextureRegistry
+{
+public:
+	//texture of the image at 'path', loaded through 'loader' (in the background) or synchronously without one
+	unsigned int acquire(const string& path, TextureLoader* loader = nullptr)
+	{
+		string canonical = canonicalPath(path);
+		auto known = paths.find(canonical);
+		if (known != paths.end())
+			return addReference(known->second);
+
+		//an image not seen at this path may still be loaded under another one
+		uint64_t key = hashBytes(&contentKeyTag, sizeof(contentKeyTag));
+		if (!hashFile(canonical, key))
+			key = hashString(canonical);
+		paths[canonical] = key;
+		if (textures.count(key))
+			return addReference(key);
+
+		RegisteredTexture& texture = textures[key];
+		texture.references = 1;
+		texture.loader = loader;
+		texture.id = loader ? loader->load2D(canonical) : TextureFromFile(canonical.c_str(), "", false);
+		keys[texture.id] = key;
+		return texture.id;
+	}
+
+	//drop a reference taken by acquire(), deleting the texture with the last one
+	void release(unsigned int textureID)
+	{
+		auto key = keys.find(textureID);
+		if (key == keys.end())
+			return;
+		RegisteredTexture& texture = textures[key->second];
+		if (--texture.references > 0)
+			return;
+
+		if (texture.loader)
+			texture.loader->forget(textureID);
+		glDeleteTextures(1, &textureID);
+		for (auto path = paths.begin(); path != paths.end();)
+		{
+			if (path->second == key->second)
+				path = paths.erase(path);
+			else
+				++path;
+		}
+		textures.erase(key->second);
+		keys.erase(key);
+	}
+
+	//number of distinct textures alive
+	size_t size() const { return textures.size(); }
+
+private:
+	struct RegisteredTexture
+	{
+		unsigned int id = 0;
+		unsigned int references = 0;
+		//what loads (and streams) it, to forget it on release
+		TextureLoader* loader = nullptr;
+	};
+
+	//separates content keys from the path keys of unreadable files
+	static constexpr uint32_t contentKeyTag = 0x54455854;
+
+	//canonical path -> content key
+	unordered_map<string, uint64_t> paths;
+	//content key -> texture
+	unordered_map<uint64_t, RegisteredTexture> textures;
+	//texture id -> content key
+	unordered_map<unsigned int, uint64_t> keys;
+
+	unsigned int addReference(uint64_t key)
+	{
+		RegisteredTexture& texture = textures[key];
+		texture.references++;
+		return texture.id;
+	}
+
+	//absolute path with '.', '..' and symbolic links resolved, so every spelling of a file gives the same string
+	static string canonicalPath(const string& path)
+	{
+		error_code error;
+		filesystem::path canonical = filesystem::weakly_canonical(filesystem::path(path), error);
+		if (error)
+			canonical = filesystem::absolute(filesystem::path(path), error).lexically_normal();
+		return canonical.string();
+	}
+};
+
+//the process-wide registry, must only be used on the GL thread
+TextureRegistry& textureRegistry()
+{
+	static TextureRegistry registry;
+	return registry;
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include <TextureCooker.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+//sampler for material textures: trilinear, repeating, and up to 16x anisotropic where supported
+//(core in GL 4.6, an extension on practically every driver before), created on first use
+//bound per texture unit by whatever draws materials, it overrides the filtering set on the textures themselves
+unsigned int materialSampler()
+{
+	static unsigned int sampler = 0;
+	if (sampler == 0)
+	{
+		glGenSamplers(1, &sampler);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		if (GLAD_GL_VERSION_4_6 || glExtensionSupported("GL_EXT_texture_filter_anisotropic")
+			|| glExtensionSupported("GL_ARB_texture_filter_anisotropic"))
+		{
+			GLfloat maxAnisotropy = 1.0f;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+			glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY, min(16.0f, maxAnisotropy));
+		}
+	}
+	return sampler;
+}
+
+//keeps only the mip levels of cooked textures that are visible on screen resident
+//every frame, draws report how large each material appears (request), and update() moves each texture's
+//GL_TEXTURE_BASE_LEVEL to the finest level that size needs: finer levels are uploaded again from the cooked data kept
+//in memory, and levels no longer needed are freed after a while, or at once when the total exceeds the budget
+//the texture keeps its id and stays complete throughout, sampling simply starts at a coarser level
+class TextureStreamer
+{
+public:
+	//'budgetBytes' of resident levels across all textures, levels unneeded for 'evictFrames' frames are freed,
+	//'uploadBytesPerFrame' bounds the levels uploaded per update (at least one level is always uploaded)
+	TextureStreamer(size_t budgetBytes = 64 * 1024 * 1024, unsigned int evictFrames = 120, size_t uploadBytesPerFrame = 8 * 1024 * 1024)
+		: budgetBytes(budgetBytes), evictFrames(evictFrames), uploadBytesPerFrame(uploadBytesPerFrame)
+	{
+	}
+
+	//stream 'textureID', which was just given every level of 'image'
+	void add(unsigned int textureID, CompressedImage image)
+	{
+		StreamedTexture& texture = textures[textureID];
+		texture.image = move(image);
+		texture.levelOffsets.clear();
+		size_t offset = 0;
+		for (size_t bytes : texture.image.levelBytes)
+		{
+			texture.levelOffsets.push_back(offset);
+			offset += bytes;
+		}
+		texture.baseLevel = 0;
+		texture.requestedPixels = 0.0f;
+		texture.unneededFrames = 0;
+	}
+
+	//stop streaming 'textureID', before it's deleted
+	void remove(unsigned int textureID)
+	{
+		textures.erase(textureID);
+	}
+
+	//'textureID' is drawn on something 'projectedPixels' across on screen this frame
+	//the texture is assumed to wrap once around it (as on the planet & rock), so about width / pi texels span its diameter
+	void request(unsigned int textureID, float projectedPixels)
+	{
+		auto found = textures.find(textureID);
+		if (found != textures.end())
+			found->second.requestedPixels = max(found->second.requestedPixels, projectedPixels);
+	}
+
+	//apply this frame's requests, call once per frame after them
+	void update()
+	{
+		//1. the level each texture should start at
+		for (auto& entry : textures)
+		{
+			StreamedTexture& texture = entry.second;
+			unsigned int wanted = neededLevel(texture);
+			texture.requestedPixels = 0.0f;
+			if (wanted > texture.baseLevel)
+				texture.unneededFrames++;
+			else
+				texture.unneededFrames = 0;
+			if (wanted < texture.baseLevel || texture.unneededFrames >= evictFrames)
+				texture.targetLevel = wanted;
+			else
+				texture.targetLevel = texture.baseLevel;
+			texture.wantedLevel = wanted;
+		}
+
+		//2. over the budget, drop the finest level of the texture where it's least needed (or largest) until it fits
+		size_t total = 0;
+		for (auto& entry : textures)
+			total += residentBytes(entry.second, entry.second.targetLevel);
+		while (total > budgetBytes)
+		{
+			StreamedTexture* coarsen = nullptr;
+			for (auto& entry : textures)
+			{
+				StreamedTexture& texture = entry.second;
+				if (texture.targetLevel + 1 >= texture.image.levelBytes.size())
+					continue;
+				if (!coarsen || evictionOrder(texture, *coarsen))
+					coarsen = &texture;
+			}
+			if (!coarsen)
+				break;
+			total -= coarsen->image.levelBytes[coarsen->targetLevel];
+			coarsen->targetLevel++;
+		}
+
+		//3. free & upload levels
+		size_t uploaded = 0;
+		for (auto& entry : textures)
+		{
+			StreamedTexture& texture = entry.second;
+			if (texture.targetLevel > texture.baseLevel)
+				evict(entry.first, texture);
+			else if (texture.targetLevel < texture.baseLevel && uploaded < uploadBytesPerFrame)
+				uploaded += load(entry.first, texture, uploadBytesPerFrame - uploaded);
+		}
+	}
+
+	//bytes of the levels resident now
+	size_t residentBytes() const
+	{
+		size_t total = 0;
+		for (const auto& entry : textures)
+			total += residentBytes(entry.second, entry.second.baseLevel);
+		return total;
+	}
+
+private:
+	struct StreamedTexture
+	{
+		//every level, to upload them again after they're freed
+		CompressedImage image;
+		vector<size_t> levelOffsets;
+		//levels from baseLevel on are resident
+		unsigned int baseLevel = 0;
+		//the level this frame's requests need, and the one update() moves to
+		unsigned int wantedLevel = 0;
+		unsigned int targetLevel = 0;
+		//largest request this frame
+		float requestedPixels = 0.0f;
+		//frames the resident levels have been finer than needed
+		unsigned int unneededFrames = 0;
+	};
+
+	size_t budgetBytes;
+	unsigned int evictFrames;
+	size_t uploadBytesPerFrame;
+	unordered_map<unsigned int, StreamedTexture> textures;
+
+	//finest level worth having for the largest request, the coarsest without any
+	static unsigned int neededLevel(const StreamedTexture& texture)
+	{
+		unsigned int coarsest = static_cast<unsigned int>(texture.image.levelBytes.size()) - 1;
+		if (texture.requestedPixels <= 0.0f)
+			return coarsest;
+		float texels = static_cast<float>(max(texture.image.width, texture.image.height)) / 3.14159265f;
+		float level = floor(log2(texels / texture.requestedPixels));
+		return static_cast<unsigned int>(min(max(level, 0.0f), static_cast<float>(coarsest)));
+	}
+
+	static size_t residentBytes(const StreamedTexture& texture, unsigned int baseLevel)
+	{
+		size_t total = 0;
+		for (size_t level = baseLevel; level < texture.image.levelBytes.size(); level++)
+			total += texture.image.levelBytes[level];
+		return total;
+	}
+
+	//whether 'a' should give up its finest target level before 'b': levels finer than needed go first, then the largest
+	static bool evictionOrder(const StreamedTexture& a, const StreamedTexture& b)
+	{
+		bool aUnneeded = a.targetLevel < a.wantedLevel, bUnneeded = b.targetLevel < b.wantedLevel;
+		if (aUnneeded != bUnneeded)
+			return aUnneeded;
+		return a.image.levelBytes[a.targetLevel] > b.image.levelBytes[b.targetLevel];
+	}
+
+	//start sampling at the target level and free the finer ones (respecified as empty images)
+	void evict(unsigned int textureID, StreamedTexture& texture)
+	{
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.targetLevel);
+		for (unsigned int level = texture.baseLevel; level < texture.targetLevel; level++)
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.image.format, 0, 0, 0, 0, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		texture.baseLevel = texture.targetLevel;
+		texture.unneededFrames = 0;
+	}
+
+	//upload levels from the one above the base down towards the target, coarse to fine, within 'budget' bytes
+	//returns the bytes uploaded
+	size_t load(unsigned int textureID, StreamedTexture& texture, size_t budget)
+	{
+		size_t uploaded = 0;
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		while (texture.baseLevel > texture.targetLevel)
+		{
+			unsigned int level = texture.baseLevel - 1;
+			size_t bytes = texture.image.levelBytes[level];
+			if (uploaded > 0 && uploaded + bytes > budget)
+				break;
+			int width = max(1, texture.image.width >> level), height = max(1, texture.image.height >> level);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.image.format, width, height, 0, static_cast<GLsizei>(bytes),
+				texture.image.data.data() + texture.levelOffsets[level]);
+			texture.baseLevel = level;
+			uploaded += bytes;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.baseLevel);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return uploaded;
+	}
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//fixed set of worker threads consuming a shared task queue
+class ThreadPool
+{
+public:
+	//constructor, one worker per hardware thread by default (the calling thread also helps in parallelFor)
+	ThreadPool(unsigned int threadCount = 0) : stopping(false)
+	{
+		if (threadCount == 0)
+		{
+			//hardware_concurrency() may report 0 when it can't tell
+			unsigned int hc = thread::hardware_concurrency();
+			threadCount = hc > 1 ? hc - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//number of worker threads
+	unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+	//queue a task to run on a worker thread
+	void submit(function<void()> task)
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			tasks.push(move(task));
+		}
+		queueCondition.notify_one();
+	}
+
+	//split [0, count) into chunks of 'grain' items and run func(begin, end) on each, returns once all chunks are done
+	//chunks are claimed dynamically, so uneven work still balances across threads
+	//must not be called from inside a pool task
+	void parallelFor(unsigned int count, unsigned int grain, const function<void(unsigned int, unsigned int)>& func)
+	{
+		if (count == 0)
+			return;
+		grain = max(1u, grain);
+		unsigned int chunkCount = (count + grain - 1) / grain;
+		if (chunkCount == 1 || workers.empty())
+		{
+			func(0, count);
+			return;
+		}
+
+		atomic<unsigned int> nextChunk(0);
+		unsigned int helpersDone = 0;
+		mutex doneMutex;
+		condition_variable doneCondition;
+
+		auto runChunks = [&]()
+		{
+			unsigned int chunk;
+			while ((chunk = nextChunk.fetch_add(1)) < chunkCount)
+			{
+				unsigned int begin = chunk * grain;
+				func(begin, min(begin + grain, count));
+			}
+		};
+
+		unsigned int helpers = min(size(), chunkCount - 1);
+		for (unsigned int i = 0; i < helpers; i++)
+		{
+			submit([&]()
+				{
+					runChunks();
+					lock_guard<mutex> lock(doneMutex);
+					helpersDone++;
+					doneCondition.notify_one();
+				});
+		}
+		runChunks();
+
+		//helpers hold references to the locals above, so wait until every one of them has left
+		unique_lock<mutex> lock(doneMutex);
+		doneCondition.wait(lock, [&] { return helpersDone == helpers; });
+	}
+
+private:
+	vector<thread> workers;
+	queue<function<void()>> tasks;
+	mutex queueMutex;
+	condition_variable queueCondition;
+	bool stopping;
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			function<void()> task;
+			{
+				unique_lock<mutex> lock(queueMutex);
+				queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty())
+					return;
+				task = move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+};
+
+#endif
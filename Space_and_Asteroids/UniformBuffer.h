@@ -0,0 +1,162 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Shader.h>
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//std140 'FrameData' block, written once per frame and read by every program that declares it
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProj;
+	glm::vec3 cameraPos;
+	//animation time of the belt
+	float time;
+};
+
+//std140 'LightData' block, vec3s padded to 16 bytes
+struct LightData
+{
+	glm::vec4 position;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+static_assert(offsetof(FrameData, viewProj) == 128 && offsetof(FrameData, cameraPos) == 192 && offsetof(FrameData, time) == 204
+	&& sizeof(FrameData) == 208, "FrameData doesn't match the std140 layout");
+static_assert(offsetof(LightData, diffuse) == 32 && sizeof(LightData) == 64, "LightData doesn't match the std140 layout");
+
+//uniform buffer holding a ring of 'frames' copies of block T, one per frame in flight, each guarded by a fence
+//update() writes the next copy and binds it to the block's fixed binding point (see UniformBlockBinding), so
+//programs never have the data uploaded to them one by one
+//uses a persistently mapped store when GL 4.4 is available, otherwise unsynchronised mapping
+template <typename T>
+class UniformRing
+{
+public:
+	//buffer object id
+	unsigned int ID;
+
+	UniformRing(GLuint binding, unsigned int frames = 3)
+		: ID(0), binding(binding), frames(frames), current(0), persistent(GLAD_GL_VERSION_4_4 != 0), mapped(nullptr)
+	{
+		fences.assign(frames, nullptr);
+
+		//every copy starts at a multiple of the offset alignment glBindBufferRange requires
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		slotSize = (static_cast<GLsizeiptr>(sizeof(T)) + alignment - 1) / alignment * alignment;
+
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_UNIFORM_BUFFER, slotSize * frames, NULL, flags);
+			mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, slotSize * frames, flags));
+			if (!mapped)
+			{
+				cout << "ERROR::UNIFORM_BUFFER::PERSISTENT_MAPPING_FAILED, falling back to mapping per frame" << endl;
+				persistent = false;
+				glDeleteBuffers(1, &ID);
+				glGenBuffers(1, &ID);
+				glBindBuffer(GL_UNIFORM_BUFFER, ID);
+			}
+		}
+		if (!persistent)
+			glBufferData(GL_UNIFORM_BUFFER, slotSize * frames, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	//write this frame's copy and bind it, before the first draw reading it
+	void update(const T& data)
+	{
+		waitForSlot(current);
+		GLintptr offset = current * slotSize;
+		if (persistent)
+		{
+			memcpy(mapped + offset, &data, sizeof(T));
+		}
+		else
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, ID);
+			void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(T),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (ptr)
+			{
+				memcpy(ptr, &data, sizeof(T));
+				glUnmapBuffer(GL_UNIFORM_BUFFER);
+			}
+			else
+			{
+				glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(T), &data);
+			}
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, offset, sizeof(T));
+	}
+
+	//call after the last draw reading this frame's copy
+	void endFrame()
+	{
+		if (fences[current])
+			glDeleteSync(fences[current]);
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current = (current + 1) % frames;
+	}
+
+	//free the GL objects, must be called while the context is still alive
+	void release()
+	{
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+		if (persistent && mapped)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, ID);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &ID);
+		ID = 0;
+	}
+
+private:
+	GLuint binding;
+	unsigned int frames;
+	unsigned int current;
+	bool persistent;
+	unsigned char* mapped;
+	GLsizeiptr slotSize;
+	vector<GLsync> fences;
+
+	void waitForSlot(unsigned int slot)
+	{
+		if (!fences[slot])
+			return;
+		GLenum result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		if (result == GL_WAIT_FAILED)
+			cout << "ERROR::UNIFORM_BUFFER::FENCE_WAIT_FAILED" << endl;
+		glDeleteSync(fences[slot]);
+		fences[slot] = nullptr;
+	}
+};
+
+#endif
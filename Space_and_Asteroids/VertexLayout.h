@@ -0,0 +1,138 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+using namespace std;
+
+//one vertex attribute: its shader location, the component count & type handed to glVertexAttrib*Pointer
+//and the bytes it takes in the buffer (may include padding)
+//'Integer' attributes reach the shader as ints (glVertexAttribIPointer), the others as floats
+template <unsigned int Location, GLint Components, GLenum Type, bool Normalized, unsigned int Bytes, bool Integer = false>
+struct VertexAttribute
+{
+	static constexpr unsigned int location = Location;
+	static constexpr GLint components = Components;
+	static constexpr GLenum type = Type;
+	static constexpr bool normalized = Normalized;
+	static constexpr unsigned int bytes = Bytes;
+	static constexpr bool integer = Integer;
+};
+
+//mesh attributes, locations 0-2 are what the shaders read
+using Pos3f = VertexAttribute<0, 3, GL_FLOAT, false, 12>;
+//unorm16 in the mesh's bounding box, padded to 8 bytes
+using Pos3u16 = VertexAttribute<0, 3, GL_UNSIGNED_SHORT, true, 8>;
+using Normal3f = VertexAttribute<1, 3, GL_FLOAT, false, 12>;
+//snorm 10_10_10_2
+using NormalPacked = VertexAttribute<1, 4, GL_INT_2_10_10_10_REV, true, 4>;
+using UV2f = VertexAttribute<2, 2, GL_FLOAT, false, 8>;
+using UV2h = VertexAttribute<2, 2, GL_HALF_FLOAT, false, 4>;
+//imported but unused by the shaders, kept clear of the instance attributes
+using Tangent3f = VertexAttribute<8, 3, GL_FLOAT, false, 12>;
+using Bitangent3f = VertexAttribute<9, 3, GL_FLOAT, false, 12>;
+using BoneIds4i = VertexAttribute<10, 4, GL_INT, false, 16, true>;
+using BoneWeights4f = VertexAttribute<11, 4, GL_FLOAT, false, 16>;
+
+//per-instance attributes of the asteroids (see AsteroidInstance)
+using InstancePos3f = VertexAttribute<3, 3, GL_FLOAT, false, 12>;
+using InstanceScaleSpeed2h = VertexAttribute<4, 2, GL_HALF_FLOAT, false, 4>;
+using InstanceOrientation4s = VertexAttribute<5, 4, GL_SHORT, true, 8>;
+
+//interleaved buffer of the given attributes, in order
+//stride and offsets are compile-time constants and setup() is the whole glVertexAttrib*Pointer sequence
+template <typename... Attributes>
+struct VertexLayout
+{
+	static constexpr unsigned int count = sizeof...(Attributes);
+	static constexpr unsigned int stride = (Attributes::bytes + ... + 0);
+
+	static constexpr unsigned int location(unsigned int i)
+	{
+		constexpr unsigned int locations[] = { Attributes::location... };
+		return locations[i];
+	}
+
+	//byte offset of attribute 'i' inside a vertex
+	static constexpr unsigned int offset(unsigned int i)
+	{
+		constexpr unsigned int sizes[] = { Attributes::bytes... };
+		unsigned int result = 0;
+		for (unsigned int a = 0; a < i; a++)
+			result += sizes[a];
+		return result;
+	}
+
+	static constexpr bool usesLocation(unsigned int location)
+	{
+		return ((Attributes::location == location) || ...);
+	}
+
+	static constexpr bool distinctLocations()
+	{
+		for (unsigned int a = 0; a < count; a++)
+		{
+			for (unsigned int b = a + 1; b < count; b++)
+			{
+				if (location(a) == location(b))
+					return false;
+			}
+		}
+		return true;
+	}
+	static_assert(count > 0, "a vertex layout needs at least one attribute");
+	static_assert(distinctLocations(), "two attributes of a vertex layout share a location");
+
+	//enable the attributes of the bound VAO and point them at the bound GL_ARRAY_BUFFER, the first vertex at byte 'base'
+	static void setup(GLintptr base = 0, GLuint divisor = 0)
+	{
+		unsigned int index = 0;
+		(setupAttribute<Attributes>(base + offset(index++), divisor), ...);
+	}
+
+private:
+	template <typename Attribute>
+	static void setupAttribute(GLintptr attributeOffset, GLuint divisor)
+	{
+		glEnableVertexAttribArray(Attribute::location);
+		if (Attribute::integer)
+			glVertexAttribIPointer(Attribute::location, Attribute::components, Attribute::type, stride, (void*)attributeOffset);
+		else
+			glVertexAttribPointer(Attribute::location, Attribute::components, Attribute::type,
+				Attribute::normalized ? GL_TRUE : GL_FALSE, stride, (void*)attributeOffset);
+		glVertexAttribDivisor(Attribute::location, divisor);
+	}
+};
+
+//the same, advancing once per instance
+template <typename... Attributes>
+struct InstanceLayout : VertexLayout<Attributes...>
+{
+	static void setup(GLintptr base = 0)
+	{
+		VertexLayout<Attributes...>::setup(base, 1);
+	}
+};
+
+//true when no location is used by more than one of the layouts (each layout checks its own attributes)
+template <typename First, typename... Others>
+constexpr bool layoutsDisjoint()
+{
+	if constexpr (sizeof...(Others) == 0)
+	{
+		return true;
+	}
+	else
+	{
+		for (unsigned int a = 0; a < First::count; a++)
+		{
+			if ((Others::usesLocation(First::location(a)) || ...))
+				return false;
+		}
+		return layoutsDisjoint<Others...>();
+	}
+}
+
+#endif